@@ -0,0 +1,251 @@
+// microbenchmarks for the simulator's hot paths
+//
+// "make bench" builds and runs these. each benchmark drives one piece of
+// the simulator with a synthetic access pattern and reports the cost per
+// operation, so slowdowns in the simulator itself show up before they
+// slow down a policy sweep. BENCH_SCALE scales the number of operations.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+
+using namespace std;
+
+#include "utils.h"
+#include "replacement_state.h"
+#include "cache.h"
+#include "trace.h"
+#include "fastcache.h"
+
+#define BENCH_OPS	(1<<22)
+
+static long long int scale = 1;
+
+// the trace reader benchmark adds its addresses into this so the reads are not optimised away
+
+static volatile unsigned long long int sink;
+
+static double now (void) {
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void report (const char *name, long long int ops, double secs) {
+	printf ("%-44s %10.2f ns/op %14.0f ops/s\n", name, secs * 1e9 / ops, ops / secs);
+	fflush (stdout);
+}
+
+// xorshift; cheap enough not to show up in the numbers
+
+static unsigned long long int rng_state = 88172645463325252ull;
+
+static inline unsigned long long int rng (void) {
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return rng_state;
+}
+
+// a prebuilt address stream so address generation stays out of the timed loop
+
+static unsigned long long int *make_stream (long long int n, unsigned long long int footprint, bool sequential) {
+	unsigned long long int *a = new unsigned long long int[n];
+	for (long long int i=0; i<n; i++)
+		a[i] = sequential ? (i * 64) % footprint : (rng () % footprint) & ~63ull;
+	return a;
+}
+
+// cache_access hits: the footprint is half the cache, so after warming everything hits
+
+static void bench_hits (int assoc, int policy) {
+	cache c;
+	int nsets = 256 * 1024 / (64 * assoc);
+	init_cache (&c, nsets, assoc, 64, policy, 0, LEVEL_LLC);
+	long long int n = BENCH_OPS * scale;
+	unsigned long long int *a = make_stream (n, nsets * assoc * 32, false);
+	for (long long int i=0; i<n; i++) cache_access (&c, a[i], 0x400000, 4, DAN_DREAD, 0);
+	double t = now ();
+	for (long long int i=0; i<n; i++) cache_access (&c, a[i], 0x400000 + (i & 255) * 4, 4, DAN_DREAD, 0);
+	t = now () - t;
+	char name[100];
+	sprintf (name, "cache_access hit %d-way policy %d", assoc, policy);
+	report (name, n, t);
+	delete [] a;
+}
+
+// cache_access misses: a sequential stream that never comes back
+
+static void bench_misses (int assoc, int policy) {
+	cache c;
+	int nsets = 256 * 1024 / (64 * assoc);
+	init_cache (&c, nsets, assoc, 64, policy, 0, LEVEL_LLC);
+	long long int n = BENCH_OPS * scale;
+	unsigned long long int *a = make_stream (n, 1ull << 40, true);
+	unsigned long long int wb;
+	double t = now ();
+	for (long long int i=0; i<n; i++) cache_access (&c, a[i], 0x400000 + (i & 255) * 4, 4, DAN_WRITEBACK, 0, &wb, true, ACCESS_5);
+	t = now () - t;
+	char name[100];
+	sprintf (name, "cache_access miss+fill %d-way policy %d", assoc, policy);
+	report (name, n, t);
+	delete [] a;
+}
+
+// the fast engine on the same hit and miss streams
+
+static void bench_fast (int assoc, bool hits) {
+	fast_cache f;
+	int nsets = 256 * 1024 / (64 * assoc), way;
+	init_fast_cache (&f, nsets, assoc, 64, REPLACEMENT_POLICY_LRU, 0, LEVEL_LLC);
+	long long int n = BENCH_OPS * scale;
+	unsigned long long int *a = hits ? make_stream (n, nsets * assoc * 32, false) : make_stream (n, 1ull << 40, true);
+	unsigned long long int wb;
+	bool wb_dirty;
+	if (hits) for (long long int i=0; i<n; i++) fast_access (&f, a[i], DAN_DREAD, true, false, &way, &wb, &wb_dirty);
+	double t = now ();
+	for (long long int i=0; i<n; i++) fast_access (&f, a[i], hits ? DAN_DREAD : DAN_WRITEBACK, true, !hits, &way, &wb, &wb_dirty);
+	t = now () - t;
+	char name[100];
+	sprintf (name, "fast_access %s %d-way LRU", hits ? "hit" : "miss+fill", assoc);
+	report (name, n, t);
+	delete [] a;
+	delete [] f.ways;
+}
+
+static void bench_invalidate (void) {
+	cache c;
+	init_cache (&c, 1024, 16, 64, REPLACEMENT_POLICY_LRU, 0, LEVEL_LLC);
+	long long int n = BENCH_OPS * scale;
+	unsigned long long int *a = make_stream (n, 1024 * 16 * 64 * 4, false);
+	for (long long int i=0; i<n; i++) cache_access (&c, a[i], 0x400000, 4, DAN_DREAD, 0);
+	double t = now ();
+	for (long long int i=0; i<n; i++) invalidate (&c, a[i]);
+	t = now () - t;
+	report ("invalidate 16-way", n, t);
+	delete [] a;
+}
+
+// the exclusive hierarchy's move up: a lookup that takes the block out
+
+static void bench_extract (void) {
+	cache c;
+	init_cache (&c, 1024, 16, 64, REPLACEMENT_POLICY_LRU, 0, LEVEL_LLC);
+	long long int n = BENCH_OPS * scale;
+	unsigned long long int *a = make_stream (n, 1024 * 16 * 64 * 4, false);
+	for (long long int i=0; i<n; i++) cache_access (&c, a[i], 0x400000, 4, DAN_DREAD, 0);
+	double t = now ();
+	for (long long int i=0; i<n; i++) cache_extract (&c, a[i], 0x400000, 4, DAN_DREAD, 0);
+	t = now () - t;
+	report ("cache_extract 16-way", n, t);
+	delete [] a;
+}
+
+// exclusive traffic: random accesses over 2MB, so the L1 misses a lot and
+// blocks move between all three levels
+
+static void bench_memory_access (int policy) {
+	cache L1[1], L2[1], L3;
+	init_cache (&L1[0], 256, 4, 64, policy, 0, LEVEL_L1);
+	init_cache (&L2[0], 512, 8, 64, policy, 0, LEVEL_L2);
+	init_cache (&L3, 4096, 16, 64, policy, 0, LEVEL_LLC);
+	long long int n = BENCH_OPS * scale;
+	unsigned long long int *a = make_stream (n, 2 * 1024 * 1024, false);
+	for (long long int i=0; i<n/4; i++) memory_access (L1, L2, &L3, a[i], 0x400000, 4, DAN_DREAD, 0);
+	double t = now ();
+	for (long long int i=0; i<n; i++) memory_access (L1, L2, &L3, a[i], 0x400000 + (i & 255) * 4, 4, (i & 7) ? DAN_DREAD : DAN_WRITE, 0);
+	t = now () - t;
+	char name[100];
+	sprintf (name, "memory_access exclusive policy %d", policy);
+	report (name, n, t);
+	delete [] a;
+}
+
+// the replacement state on its own, as a cache would drive it on a miss
+
+static void bench_replacement (int assoc, int policy) {
+	int nsets = 4096;
+	CACHE_REPLACEMENT_STATE *r = new CACHE_REPLACEMENT_STATE (nsets, assoc, policy);
+	long long int n = BENCH_OPS * scale;
+	LINE_STATE ls;
+	memset (&ls, 0, sizeof (ls));
+	double t = now ();
+	for (long long int i=0; i<n; i++) {
+		unsigned long long int x = rng ();
+		UINT32 set = x % nsets;
+		ls.tag = x >> 12;
+		ls.filling_pc = 0x400000 + (x & 1023) * 4;
+		ls.signature = ls.filling_pc & 0xffff;
+		INT32 way = r->GetVictimInSet (0, set, &ls, assoc, ls.filling_pc, x, ACCESS_WRITEBACK, ACCESS_5);
+		if (way < 0) continue;
+		r->UpdateReplacementState (set, way, &ls, 0, ls.filling_pc, ACCESS_WRITEBACK, (x >> 40) & 1, ACCESS_5);
+	}
+	t = now () - t;
+	char name[100];
+	sprintf (name, "GetVictimInSet+Update %d-way policy %d", assoc, policy);
+	report (name, n, t);
+	delete r;
+}
+
+// tracereader::read on a synthetic trace in both file formats
+
+static void bench_tracereader (void) {
+	char gzname[100], ctname[100];
+	sprintf (gzname, "/tmp/exclusiu-bench-%d.gz", (int) getpid ());
+	sprintf (ctname, "/tmp/exclusiu-bench-%d.xtr", (int) getpid ());
+	long long int n = BENCH_OPS * scale;
+	gzFile gz = gzopen (gzname, "w");
+	assert (gz);
+	ctrace_writer ct (ctname);
+	trace t;
+	memset (&t, 0, sizeof (t));
+	for (long long int i=0; i<n; i++) {
+		unsigned long long int x = rng ();
+		t.cmd = (x & 7) ? ACCESS_LOAD : ACCESS_STORE;
+		t.size = 4;
+		t.pc = 0x400000 + ((x >> 3) & 255) * 4;
+		t.address = (x & 1) ? t.address + 64 : (x >> 8) & 0xfffffffc0ull;
+		t.instr += 1 + ((x >> 48) & 15);
+		t.cycle = t.instr;
+		gzwrite (gz, &t, sizeof (t));
+		ct.write (&t);
+	}
+	gzclose (gz);
+	ct.close ();
+	const char *names[2] = { gzname, ctname };
+	const char *labels[2] = { "tracereader::read gzip", "tracereader::read chunked" };
+	for (int f=0; f<2; f++) {
+		tracereader *r = new tracereader (names[f], 1ull << 62);
+		double s = now ();
+		unsigned long long int sum = 0;
+		for (long long int i=0; i<n; i++) sum += r->read ()->address;
+		s = now () - s;
+		report (labels[f], n, s);
+		sink += sum;
+		delete r;
+		unlink (names[f]);
+	}
+}
+
+int main (int argc, char *argv[]) {
+	char *s = getenv ("BENCH_SCALE");
+	if (s) scale = atoll (s);
+	int assocs[5] = { 4, 8, 16, 32, 64 };
+	for (int p=0; p<=REPLACEMENT_POLICY_CRC; p++)
+		for (int a=0; a<5; a++) bench_hits (assocs[a], p);
+	for (int p=0; p<=REPLACEMENT_POLICY_CRC; p++)
+		for (int a=0; a<5; a++) bench_misses (assocs[a], p);
+	for (int a=0; a<5; a++) bench_fast (assocs[a], true);
+	for (int a=0; a<5; a++) bench_fast (assocs[a], false);
+	bench_invalidate ();
+	bench_extract ();
+	for (int p=0; p<=REPLACEMENT_POLICY_CRC; p++) bench_memory_access (p);
+	for (int p=0; p<=REPLACEMENT_POLICY_CRC; p++)
+		for (int a=0; a<5; a++) bench_replacement (assocs[a], p);
+	bench_tracereader ();
+	return 0;
+}
@@ -2,18 +2,33 @@
 
 #include <stdio.h>
 #include <assert.h>
+#include <math.h>
+#include <string.h>
 #include "utils.h"
 #include "replacement_state.h"
 #include "cache.h"
+#include "fastcache.h"
+#include "ucp.h"
+#include "coherence.h"
+#include "prefetch.h"
+#include "pcprof.h"
 
 using namespace std;
 
 static unsigned int random_counter = 0;
 
-void place (cache *c, unsigned long long int pc, unsigned int set, block *b, int offset) {
-	// which pc filled this block
+int inclusion = INCLUSION_EXCLUSIVE;
+hierarchy_traffic traffic;
+directory *coherence = NULL;
 
-	b->filling_pc = pc;
+void place (cache *c, const LINE_STATE *ls, unsigned int set, block *b, int offset) {
+	// which pc filled this block, and what it carries from the levels above
+
+	b->filling_pc = ls->filling_pc;
+	b->signature = ls->signature;
+	b->reuse = ls->reuse;
+	b->hits = 0;
+	b->rewritten = false;
 
 	// which *byte* offset filled this block
 
@@ -34,11 +49,16 @@ int lg2 (int n) {
 
 // make a cache.  hope blocksize and nsets are a power of 2.
 
-void init_cache (cache *c, int nsets, int assoc, int blocksize, int replacement_policy, int set_shift) {
+void init_cache (cache *c, int nsets, int assoc, int blocksize, int replacement_policy, int set_shift, int level) {
 	int i, j;
+	assert (assoc >= 1 && assoc <= MAX_ASSOC);
 	c->sets = new set[nsets];
+	c->blocks = new block[(size_t) nsets * assoc];
+	for (i=0; i<nsets; i++) c->sets[i].blocks = &c->blocks[(size_t) i * assoc];
 	c->replacement_policy = replacement_policy;
 	c->repl = new CACHE_REPLACEMENT_STATE (nsets, assoc, replacement_policy);
+	c->repl->SetLevel (level);
+	c->level = level;
 	c->set_shift = set_shift;
 	c->nsets = nsets;
 	c->assoc = assoc;
@@ -53,6 +73,7 @@ void init_cache (cache *c, int nsets, int assoc, int blocksize, int replacement_
 	for (i=0; i<nsets; i++) {
 		for (j=0; j<assoc; j++) {
 			block *b = &c->sets[i].blocks[j];
+			b->lru_stack_position = j;
 			b->tag = 0;
 			b->valid = 0;
 			b->dirty = 0;
@@ -61,6 +82,130 @@ void init_cache (cache *c, int nsets, int assoc, int blocksize, int replacement_
 	}
 }
 
+// choose how the cache maps blocks to sets (INDEX_MODULO etc.), before it is used
+
+void set_index_function (cache *c, int index_fn) {
+	assert (c->accesses == 0);
+	assert (index_fn >= INDEX_MODULO && index_fn <= INDEX_SKEW);
+	c->index_fn = index_fn;
+
+	// prime modulo leaves the sets above the largest prime unused
+
+	unsigned int p = c->nsets;
+	if (index_fn == INDEX_PRIME) {
+		for (; p > 2; p--) {
+			unsigned int d;
+			for (d=2; d*d<=p; d++) if (p % d == 0) break;
+			if (d*d > p) break;
+		}
+	}
+	c->index_prime = p;
+}
+
+// write-aware LRU: a full set's victim is the least recently used block
+// among the window LRU-most ones that is clean, or dirty but not predicted
+// to be rewritten. evicting a dirty block costs a memory write; one that
+// would be written (or reused) again if kept is the write worth saving,
+// while a dead dirty block's write comes sooner or later either way. the
+// prediction is a 2-bit counter per filling-pc signature, counted up when
+// a dirty block takes another dirty writeback or a demand hit and down when
+// one is evicted without either. if every block in the window is dirty and
+// predicted to be rewritten, the LRU block goes.
+
+#define REWRITE_PRED_SIZE	4096
+
+void set_write_aware (cache *c, int window) {
+	assert (c->replacement_policy == REPLACEMENT_POLICY_LRU && c->index_fn != INDEX_SKEW);
+	if (window > c->assoc) window = c->assoc;
+	c->write_window = window;
+	if (!window) return;
+	c->rewrite_pred = new unsigned char[REWRITE_PRED_SIZE];
+	memset (c->rewrite_pred, 1, REWRITE_PRED_SIZE);
+}
+
+static inline unsigned char *rewrite_counter (cache *c, const block *b) {
+	return &c->rewrite_pred[b->signature % REWRITE_PRED_SIZE];
+}
+
+static inline int write_aware_victim (cache *c, const block *v, int assoc) {
+	for (int i=assoc-1; i>=assoc-c->write_window; i--) {
+		if (!v[i].dirty || *rewrite_counter (c, &v[i]) < 2) {
+			if (i != assoc-1) c->dirty_spared++;
+			return i;
+		}
+	}
+	return assoc - 1;
+}
+
+// keep a count of demand and prefetch misses in each set, for print_set_pressure
+
+void count_set_misses (cache *c) {
+	c->set_misses = new unsigned long long int[c->nsets];
+	memset (c->set_misses, 0, sizeof (unsigned long long int) * c->nsets);
+}
+
+// how evenly the misses spread over the sets: a histogram of each set's
+// misses relative to the mean, and the hottest sets. conflict hot spots
+// show up as a long tail
+
+void print_set_pressure (cache *c, const char *name) {
+	if (!c->set_misses) return;
+	unsigned int nsets = c->index_fn == INDEX_PRIME ? c->index_prime : c->nsets;
+	double total = 0, sq = 0;
+	for (unsigned int i=0; i<nsets; i++) {
+		total += c->set_misses[i];
+		sq += (double) c->set_misses[i] * c->set_misses[i];
+	}
+	double mean = total / nsets;
+	double sd = sqrt (sq / nsets - mean * mean);
+	const char *labels[] = { "0", "<1/4", "<1/2", "<1", "<2", "<4", "<8", ">=8" };
+	const double bounds[] = { 0.25, 0.5, 1, 2, 4, 8 };
+	unsigned int hist[8];
+	memset (hist, 0, sizeof (hist));
+	for (unsigned int i=0; i<nsets; i++) {
+		int b = 0;
+		if (c->set_misses[i]) {
+			for (b=1; b<7; b++) if (c->set_misses[i] < bounds[b-1] * mean) break;
+		}
+		hist[b]++;
+	}
+	printf ("%s set misses: mean %0.1f coefficient of variation %0.3f over %u sets\n", name, mean, mean > 0 ? sd / mean : 0.0, nsets);
+	printf ("%s sets by misses/mean:", name);
+	for (int b=0; b<8; b++) printf (" %s: %u", labels[b], hist[b]);
+	printf ("\n%s hottest sets:", name);
+	unsigned int top[8];
+	int ntop = 0;
+	for (unsigned int i=0; i<nsets; i++) {
+		int j;
+		for (j=ntop; j>0 && c->set_misses[top[j-1]] < c->set_misses[i]; j--)
+			if (j < 8) top[j] = top[j-1];
+		if (j < 8) {
+			top[j] = i;
+			if (ntop < 8) ntop++;
+		}
+	}
+	for (int j=0; j<ntop; j++) printf (" %u (%lld)", top[j], c->set_misses[top[j]]);
+	printf ("\n");
+}
+
+// how full the cache is: the fraction of sets that have been full at some
+// point, which is what sets[].valid records, and the fraction of blocks
+// that are valid now. a skewed cache has no sets of its own, so both are
+// the second
+
+void fill_state (cache *c, double *full_sets, double *valid_blocks) {
+	int n = 0, blocks = c->nsets * c->assoc;
+	for (int i=0; i<blocks; i++) n += c->blocks[i].valid;
+	*valid_blocks = n / (double) blocks;
+	if (c->index_fn == INDEX_SKEW) {
+		*full_sets = *valid_blocks;
+		return;
+	}
+	n = 0;
+	for (int i=0; i<c->nsets; i++) n += c->sets[i].valid;
+	*full_sets = n / (double) c->nsets;
+}
+
 // move a block to the MRU position
 
 void move_to_mru (block *v, int i) {
@@ -70,51 +215,113 @@ void move_to_mru (block *v, int i) {
 	v[0] = b;
 }
 
-// invalidate a block out of this cache! the block might not be there, but if it is, we'll blow it away
+// take a valid block out of the cache, returning whether it was dirty
+
+static inline bool remove_block (cache *c, block *b, unsigned long long int block_addr) {
+	if (c->dir) directory_drop (c->dir, block_addr, c->dir_bit);
+	b->valid = 0;
+	c->invalidations++;
+	return b->dirty;
+}
+
+// invalidate a block out of this cache! the block might not be there, but if it is, we'll blow it away.
+// returns true if it was there and dirty, i.e. the data has to go somewhere. an
+// invalid block can still have the tag from before, so only a valid one counts
 
-void invalidate (cache *c, unsigned long long int address) {
+bool invalidate (cache *c, unsigned long long int address) {
+	bool dirty = false;
 	int i, assoc = c->assoc;
 	block *v;
 	unsigned long long int block_addr = address >> c->offset_bits;
-	unsigned long long int tag = block_addr >> c->index_bits;
-	unsigned int set = (block_addr >> c->set_shift) & c->index_mask;
-	v = &c->sets[set].blocks[0];
+	unsigned long long int tag = index_tag (c, block_addr);
+	unsigned int set = index_set (c, block_addr);
+	v = &c->blocks[(size_t) set * assoc];
 	for (i=0; i<assoc; i++) {
-		if (v[i].tag == tag) {
-			v[i].valid = 0;
-			c->invalidations++;
+
+		// each way of a skewed cache has its own set
+
+		if (c->index_fn == INDEX_SKEW) v = &c->blocks[(size_t) index_set (c, block_addr, i) * assoc];
+		if (v[i].valid && v[i].tag == tag) {
+			dirty = remove_block (c, &v[i], block_addr);
 			break;
 		}
 	}
-	
+	if (c->ucp) ucp_invalidate (c->ucp, c, address);
+	if (c->lockstep) lockstep_invalidate (c, address, i < assoc);
+	return dirty;
 }
 
 // access a cache, return true for miss, false for hit
 
-#define check_writeback(b) { if (writeback_address && v[(b)].valid && (v[(b)].dirty || (assoc!=16))) *writeback_address = ((v[(b)].tag << c->index_bits) + set) << c->offset_bits; }
+#define check_writeback(b) { note_eviction (c, &v[(b)], set, (b)); if (writeback_address && v[(b)].valid && (v[(b)].dirty || c->level != LEVEL_LLC)) { *writeback_address = c->evicted_address; if (writeback_meta) get_meta (&v[(b)], writeback_meta); } }
+
+// remember the block a fill replaces, dirty or not; an inclusive LLC has to
+// invalidate it out of the levels above
+
+static inline void note_eviction (cache *c, const block *b, unsigned int set, int way) {
+	c->evicted = b->valid;
+	c->evicted_dirty = b->valid && b->dirty;
+	c->evicted_address = index_block (c, b->tag, set, way) << c->offset_bits;
+	c->evicted_pc = b->filling_pc;
+	c->evicted_hits = b->hits;
+}
+
+// fill in the metadata an evicted block carries to the next level
+
+static inline void get_meta (const block *b, block_meta *m) {
+	m->filling_pc = b->filling_pc;
+	m->signature = b->signature;
+	m->hits = b->hits;
+	m->reuse = (b->reuse << 1) | (b->hits > 0);
+	m->prefetched = b->prefetched;
+	m->dirty = b->dirty;
+}
+
+// count a prefetched block that is about to be replaced without ever having seen a demand hit
+
+#define check_prefetch_useless(b) { if (v[(b)].valid && v[(b)].prefetched) c->pf_useless++; }
+
+// a bypassed block is remembered here so a later miss on it counts as a bad bypass
+
+static inline unsigned int bypass_slot (cache *c, unsigned long long int block_addr) {
+	return (unsigned int) ((block_addr * 0x9e3779b97f4a7c15ull) >> 32) % (c->nsets * c->assoc);
+}
 
-bool cache_access (cache *c, unsigned long long int address, unsigned long long int pc, unsigned int size, int op, unsigned int core, unsigned long long int *writeback_address = NULL, bool do_place = true, int access_source = 0) {
+// fill_meta describes the block being placed when it is a victim from the
+// level above or the block moving up from the level below; writeback_meta
+// returns the same for the block we evict. a block with fill_meta keeps its
+// dirty bit whatever the op; without it the block is new to the hierarchy and
+// only a writeback is taken as dirty.
+// with extract (and not do_place), a hit also takes the block out of the
+// cache and returns its metadata in writeback_meta, as cache_extract.
+//
+// ASSOC is the associativity when it is known at compile time, so the way
+// loops of the common shapes unroll; 0 takes it from the cache.
+
+template <int ASSOC>
+static inline bool reference_access (cache *c, unsigned long long int address, unsigned long long int pc, unsigned int size, int op, unsigned int core, unsigned long long int *writeback_address, bool do_place, int access_source, block_meta *writeback_meta, const block_meta *fill_meta, bool extract) {
 	c->counts[op]++;
-	int i, assoc = c->assoc;
+	int i;
+	const int assoc = ASSOC ? ASSOC : c->assoc;
 	block *v;
 	unsigned int offset = address & (c->blocksize - 1);
 	unsigned long long int block_addr = address >> c->offset_bits;
-	unsigned int set = (block_addr >> c->set_shift) & c->index_mask;
+	unsigned int set = index_set (c, block_addr);
 
-	// note this doesn't generate the right tag if we have a non-zero set shift
-	// we *do* need the right tag value for things like the sampler to work
-	// because the sampler recontstructs the physical address from the tag & index
+	// the tag and index together give back the address, whatever the index
+	// function; the sampler relies on that
 
-	unsigned long long int tag = block_addr >> c->index_bits;
+	unsigned long long int tag = index_tag (c, block_addr);
 
 	// this will be true if the current set contains only valid blocks, false otherwise
 
 	int set_valid = c->sets[set].valid;
 	set_valid = false; // we can get back-invalidations so we can't use this optimization here
 	c->accesses++;
-	v = &c->sets[set].blocks[0];
+	v = &c->blocks[(size_t) set * assoc];
 	LINE_STATE ls;
 	if (writeback_address) *writeback_address = 0;
+	c->evicted = false;
 	AccessTypes at;
 	switch (op) {
 		case DAN_PREFETCH: at = ACCESS_PREFETCH; break;
@@ -126,12 +333,33 @@ bool cache_access (cache *c, unsigned long long int address, unsigned long long
 		printf ("op is %d!\n", op); fflush (stdout);
 		assert (0);
 	}
+	bool fill_dirty = fill_meta ? fill_meta->dirty : at == ACCESS_WRITEBACK;
 	
 	// tag match?
 
 	for (i=0; i<assoc; i++) {
 		if (v[i].tag == tag && v[i].valid) {
-			if (at == ACCESS_STORE || at == ACCESS_WRITEBACK) v[i].dirty = true;
+			if (c->rewrite_pred && v[i].dirty && !v[i].rewritten && (at != ACCESS_WRITEBACK || fill_dirty)) {
+				unsigned char *p = rewrite_counter (c, &v[i]);
+				if (*p < 3) (*p)++;
+				v[i].rewritten = true;
+			}
+			if (at == ACCESS_STORE || fill_dirty) v[i].dirty = true;
+
+			// tell the policy whether this is the first demand use of a prefetched block
+
+			c->last_way = i;
+			ls.prefetched = v[i].prefetched;
+			ls.filling_pc = v[i].filling_pc;
+			ls.offset = v[i].offset;
+			ls.signature = v[i].signature;
+			ls.hits = v[i].hits;
+			ls.reuse = v[i].reuse;
+			if (at != ACCESS_WRITEBACK) v[i].hits++;
+			if (v[i].prefetched && at != ACCESS_PREFETCH && at != ACCESS_WRITEBACK) {
+				c->pf_useful++;
+				v[i].prefetched = false;
+			}
 			if (c->replacement_policy == REPLACEMENT_POLICY_LRU) {
 				// move this block to the mru position
 				if (i != 0) move_to_mru (v, i);
@@ -146,6 +374,17 @@ bool cache_access (cache *c, unsigned long long int address, unsigned long long
 				if (at != ACCESS_WRITEBACK)
 					c->repl->UpdateReplacementState (set, i, &ls, core, pc, at, true, access_source);
 			}
+
+			// the policy's statistics still count what it wasn't told about
+
+			if (at == ACCESS_WRITEBACK || c->replacement_policy == REPLACEMENT_POLICY_RANDOM)
+				c->repl->CountAccessOnly (at, true, access_source, -1);
+			if (extract) {
+				// under LRU the block is now at the top of the set
+				block *b = &v[c->replacement_policy == REPLACEMENT_POLICY_LRU ? 0 : i];
+				if (writeback_meta) get_meta (b, writeback_meta);
+				remove_block (c, b, block_addr);
+			}
 			return false;
 		}
 	}
@@ -153,10 +392,42 @@ bool cache_access (cache *c, unsigned long long int address, unsigned long long
 	// a miss.
 
 	c->misses++;
+	if (c->set_misses && at != ACCESS_WRITEBACK) c->set_misses[set]++;
+
+	// was this block bypassed recently? then the bypass cost us a hit
+
+	if (c->bypass_shadow && at != ACCESS_WRITEBACK) {
+		unsigned int slot = bypass_slot (c, block_addr);
+		if (c->bypass_shadow[slot] == block_addr + 1) {
+			c->bypass_reused++;
+			c->bypass_shadow[slot] = 0;
+		}
+	}
 
 	// should we place this block in the cache? if not, just return
 
-	if (!do_place) return true;
+	c->last_way = -1;
+	if (!do_place) {
+		c->repl->CountAccessOnly (at, false, access_source, -1);
+		return true;
+	}
+	c->fills++;
+
+	// a block placed by a prefetch, or an unused prefetched victim from the level above
+
+	ls.prefetched = (at == ACCESS_PREFETCH) || (fill_meta && fill_meta->prefetched);
+	if (ls.prefetched) c->pf_fills++;
+	ls.offset = offset;
+	ls.hits = 0;
+	if (fill_meta) {
+		ls.filling_pc = fill_meta->filling_pc;
+		ls.signature = fill_meta->signature;
+		ls.reuse = fill_meta->reuse;
+	} else {
+		ls.filling_pc = pc;
+		ls.signature = pc_signature (pc);
+		ls.reuse = 0;
+	}
 
 	// find a block to replace
 
@@ -175,28 +446,41 @@ bool cache_access (cache *c, unsigned long long int address, unsigned long long
 		// if no invalid block, choose a random one
 
 		if (set_valid) i = (random_counter++) % assoc; // replace
+		if (set_valid && c->ucp) i = ucp_victim (c->ucp, c, set, block_addr, i);
+		c->last_way = i;
 		check_writeback (i);
-		if (at == ACCESS_STORE || at == ACCESS_WRITEBACK) 
+		check_prefetch_useless (i);
+		if (at == ACCESS_STORE || fill_dirty) 
 			v[i].dirty = true;
 		else
 			v[i].dirty = false;
+		v[i].prefetched = ls.prefetched;
 		v[i].tag = tag;
 		v[i].valid = 1;
-		place (c, pc, set, &v[i], offset);
+		place (c, &ls, set, &v[i], offset);
+		c->repl->CountAccessOnly (at, false, access_source, -1);
 	} else if (c->replacement_policy == REPLACEMENT_POLICY_LRU) {
 
 		// if no invalid block, use the lru one (the one in the last position)
 
-		if (set_valid) i = assoc - 1; // replace LRU block
+		if (set_valid) i = c->write_window ? write_aware_victim (c, v, assoc) : assoc - 1; // replace LRU block
+		if (set_valid && c->ucp) i = ucp_victim (c->ucp, c, set, block_addr, i);
+		c->last_way = i;
+		if (c->rewrite_pred && v[i].valid && v[i].dirty && !v[i].rewritten) {
+			unsigned char *p = rewrite_counter (c, &v[i]);
+			if (*p) (*p)--;
+		}
 		check_writeback (i);
+		check_prefetch_useless (i);
 		if (i != 0) move_to_mru (v, i);
-		if (at == ACCESS_STORE || at == ACCESS_WRITEBACK) 
+		if (at == ACCESS_STORE || fill_dirty) 
 			v[0].dirty = true;
 		else
 			v[0].dirty = false;
+		v[0].prefetched = ls.prefetched;
 		v[0].tag = tag;
 		v[0].valid = 1;
-		place (c, pc, set, &v[0], offset);
+		place (c, &ls, set, &v[0], offset);
 
 		// update CRC's LRU policy (for instrumentation)
 		ls.tag = tag;
@@ -206,27 +490,58 @@ bool cache_access (cache *c, unsigned long long int address, unsigned long long
 			for (int z=0; z<(int)assoc; z++) if (c->repl->repl[set][z].LRUstackposition == (unsigned) assoc-1) { lru = z; break; }
 			assert (lru >= 0);
 			c->repl->UpdateReplacementState (set, lru, &ls, core, pc, at, false, access_source);
-		}
+		} else c->repl->CountAccessOnly (at, false, access_source, 0);
 	} else {
 		// assume we are using CRC replacement policy, see what it wants to replace
+		ls.tag = tag;
 		if (set_valid) {
-			i = c->repl->GetVictimInSet (core, set, NULL, assoc, pc, address, at, access_source); // replace
+			i = c->repl->GetVictimInSet (core, set, &ls, assoc, pc, address, at, access_source); // replace
+
+			// a partitioned cache may move the victim to another core's block, but not undo a bypass
+
+			if (c->ucp && i != -1) i = ucp_victim (c->ucp, c, set, block_addr, i);
 		}
-		ls.tag = tag;
 
 		// -1 means bypass
 
+		c->last_way = i;
 		if (i != -1) {
 			check_writeback (i);
-			if (at == ACCESS_STORE || at == ACCESS_WRITEBACK) 
+			check_prefetch_useless (i);
+			if (at == ACCESS_STORE || fill_dirty) 
 				v[i].dirty = true;
 			else
 				v[i].dirty = false;
+			v[i].prefetched = ls.prefetched;
 			v[i].tag = tag;
 			v[i].valid = 1;
 			assert (i >= 0 && i < assoc);
 			c->repl->UpdateReplacementState (set, i, &ls, core, pc, at, false, access_source);
-			place (c, pc, set, &v[i], offset);
+			place (c, &ls, set, &v[i], offset);
+		} else {
+			// bypass: the incoming block is its own victim. a clean block is
+			// dropped; a dirty one (or any block in an upper level) goes on down
+
+			bool dirty = at == ACCESS_STORE || fill_dirty;
+			c->bypasses++;
+			if (dirty) c->bypass_dirty++;
+			c->repl->CountAccessOnly (at, false, access_source, -1);
+			if (writeback_address && (dirty || c->level != LEVEL_LLC)) {
+				*writeback_address = block_addr << c->offset_bits;
+				if (writeback_meta) {
+					writeback_meta->filling_pc = ls.filling_pc;
+					writeback_meta->signature = ls.signature;
+					writeback_meta->hits = 0;
+					writeback_meta->reuse = ls.reuse << 1;
+					writeback_meta->prefetched = ls.prefetched;
+					writeback_meta->dirty = dirty;
+				}
+			}
+			if (!c->bypass_shadow) {
+				c->bypass_shadow = new unsigned long long int[c->nsets * c->assoc];
+				memset (c->bypass_shadow, 0, sizeof (unsigned long long int) * c->nsets * c->assoc);
+			}
+			c->bypass_shadow[bypass_slot (c, block_addr)] = block_addr + 1;
 		}
 	}
 	// only count as a miss if the block is not a writeback block or prefetch
@@ -236,63 +551,381 @@ bool cache_access (cache *c, unsigned long long int address, unsigned long long
 	return true;
 }
 
+// the skewed-associative cache (Seznec, ISCA 1993): way w of a block can
+// only be in set index_set (c, block_addr, w), so blocks that conflict in
+// one way usually don't in the others. the candidates for a block aren't
+// one set, so there is no recency order to keep in the blocks array: LRU
+// replaces the candidate with the oldest last use and random a random way.
+// the CRC policies need sets and aren't supported. misses are counted
+// against the block's way 0 set.
+
+static bool skewed_access (cache *c, unsigned long long int address, unsigned long long int pc, int op, unsigned long long int *writeback_address, bool do_place, block_meta *writeback_meta, const block_meta *fill_meta, bool extract) {
+	c->counts[op]++;
+	c->accesses++;
+	c->clock++;
+	int i, assoc = c->assoc;
+	unsigned long long int block_addr = address >> c->offset_bits;
+	unsigned long long int tag = index_tag (c, block_addr);
+	unsigned int offset = address & (c->blocksize - 1);
+	if (writeback_address) *writeback_address = 0;
+	c->evicted = false;
+	bool writeback = op == DAN_WRITEBACK, prefetch = op == DAN_PREFETCH;
+	bool dirty = op == DAN_WRITE || (fill_meta ? fill_meta->dirty : writeback);
+	unsigned int sets[MAX_ASSOC];
+
+	// tag match in any way?
+
+	for (i=0; i<assoc; i++) {
+		sets[i] = index_set (c, block_addr, i);
+		block *b = &c->blocks[(size_t) sets[i] * assoc + i];
+		if (b->tag == tag && b->valid) {
+			if (dirty) b->dirty = true;
+			c->last_way = i;
+			b->last_use = c->clock;
+			if (!writeback) b->hits++;
+			if (b->prefetched && !prefetch && !writeback) {
+				c->pf_useful++;
+				b->prefetched = false;
+			}
+			if (extract) {
+				if (writeback_meta) get_meta (b, writeback_meta);
+				remove_block (c, b, block_addr);
+			}
+			return false;
+		}
+	}
+	c->misses++;
+	if (c->set_misses && !writeback) c->set_misses[sets[0]]++;
+	c->last_way = -1;
+	if (!do_place) return true;
+	c->fills++;
+
+	// an invalid candidate, or the policy's choice
+
+	for (i=0; i<assoc; i++) if (!c->blocks[(size_t) sets[i] * assoc + i].valid) break;
+	if (i == assoc) {
+		if (c->replacement_policy == REPLACEMENT_POLICY_RANDOM) {
+			i = (random_counter++) % assoc;
+		} else {
+			i = 0;
+			for (int w=1; w<assoc; w++)
+				if (c->blocks[(size_t) sets[w] * assoc + w].last_use < c->blocks[(size_t) sets[i] * assoc + i].last_use) i = w;
+		}
+	}
+	unsigned int set = sets[i];
+	block *v = &c->blocks[(size_t) set * assoc];
+	c->last_way = i;
+	check_writeback (i);
+	check_prefetch_useless (i);
+	LINE_STATE ls;
+	ls.prefetched = prefetch || (fill_meta && fill_meta->prefetched);
+	if (ls.prefetched) c->pf_fills++;
+	ls.filling_pc = fill_meta ? fill_meta->filling_pc : pc;
+	ls.signature = fill_meta ? fill_meta->signature : pc_signature (pc);
+	ls.reuse = fill_meta ? fill_meta->reuse : 0;
+	v[i].dirty = dirty;
+	v[i].prefetched = ls.prefetched;
+	v[i].tag = tag;
+	v[i].valid = 1;
+	v[i].last_use = c->clock;
+	place (c, &ls, set, &v[i], offset);
+	return true;
+}
+
+static inline bool dispatch_access (cache *c, unsigned long long int address, unsigned long long int pc, unsigned int size, int op, unsigned int core, unsigned long long int *writeback_address, bool do_place, int access_source, block_meta *writeback_meta, const block_meta *fill_meta, bool extract) {
+	if (c->ucp) ucp_observe (c->ucp, c, address, op, do_place);
+	bool profiled = c->prof && pc_profile_sampled (c->prof, c, address);
+	bool miss;
+	if (c->index_fn == INDEX_SKEW) miss = skewed_access (c, address, pc, op, writeback_address, do_place, writeback_meta, fill_meta, extract);
+	else switch (c->assoc) {
+#define REFERENCE_ACCESS(n) reference_access<n> (c, address, pc, size, op, core, writeback_address, do_place, access_source, writeback_meta, fill_meta, extract)
+		case 4: miss = REFERENCE_ACCESS (4); break;
+		case 8: miss = REFERENCE_ACCESS (8); break;
+		case 16: miss = REFERENCE_ACCESS (16); break;
+		case 32: miss = REFERENCE_ACCESS (32); break;
+		case 64: miss = REFERENCE_ACCESS (64); break;
+		default: miss = REFERENCE_ACCESS (0);
+#undef REFERENCE_ACCESS
+	}
+	if (c->lockstep) lockstep_access (c, address, pc, op, do_place, miss, writeback_address, extract ? NULL : writeback_meta, fill_meta);
+
+	if (profiled) {
+		pc_profile_access (c->prof, c, address, pc, op, miss);
+		if (miss && c->last_way >= 0) pc_profile_fill (c->prof, c, fill_meta ? fill_meta->filling_pc : pc);
+	}
+
+	// a private cache tells the directory what it placed and what that replaced
+
+	if (c->dir && miss && c->last_way >= 0) {
+		if (c->evicted) directory_drop (c->dir, c->evicted_address >> c->offset_bits, c->dir_bit);
+		directory_fill (c->dir, address >> c->offset_bits, c->dir_bit);
+	}
+	if (extract) {
+		if (c->ucp) ucp_invalidate (c->ucp, c, address);
+		if (c->lockstep) lockstep_invalidate (c, address, !miss);
+	}
+	return miss;
+}
+
+bool cache_access (cache *c, unsigned long long int address, unsigned long long int pc, unsigned int size, int op, unsigned int core, unsigned long long int *writeback_address, bool do_place, int access_source, block_meta *writeback_meta, const block_meta *fill_meta) {
+	return dispatch_access (c, address, pc, size, op, core, writeback_address, do_place, access_source, writeback_meta, fill_meta, false);
+}
+
+// look up a block without placing it and, if it is there, take it out of
+// the cache: a cache_access with do_place false and an invalidate in one
+// scan of the set. this is how a block moves up in the exclusive hierarchy.
+// returns true for a miss; on a hit *meta, if given, gets the block's metadata
+
+bool cache_extract (cache *c, unsigned long long int address, unsigned long long int pc, unsigned int size, int op, unsigned int core, int access_source, block_meta *meta) {
+	return dispatch_access (c, address, pc, size, op, core, NULL, false, access_source, meta, NULL, true);
+}
+
 // access the memory, returning an integer that has:
 // bit 0 set if there is a miss in L1
 // bit 1 set if there is a miss in L2
 // bit 2 set if there is a miss in L3
+// MISS_MEMORY if the demand access went all the way to memory; unlike
+// MISS_L3_DEMAND it isn't also set by a writeback missing in the L3.
+// MISS_REMOTE, and neither of those, if it missed in the LLC but another
+// core's private cache had the block to send (shared address space only).
+// MISS_L3_WRITEBACK if the LLC wrote a block back to memory, and
+// MISS_L3_2ND_WRITEBACK as well if it wrote back more than one.
+// memory_writebacks, if given, has room for MAX_MEMORY_WRITEBACKS blocks and
+// gets the ones the LLC wrote back, followed by a 0 if there are fewer
 
 // private L1 and L2, shared L3
 
-unsigned int memory_access (cache *L1, cache *L2, cache *L3, unsigned long long int address, unsigned long long int pc, unsigned int size, int op, unsigned int core) {
+// the inclusive and non-inclusive hierarchies: a miss fills every level it
+// missed in, and a victim only goes down if it is dirty. an inclusive LLC
+// also takes each block it evicts out of the owning core's L1 and L2; a
+// dirty copy found there goes to memory. (a block the LLC's policy bypasses
+// is not in the LLC, so inclusion doesn't cover it.)
+
+static unsigned long long int *llc_memory_writebacks;
+static int llc_memory_writeback_count;
+
+// a block leaving the LLC for memory
+
+static unsigned int llc_to_memory (unsigned long long int block) {
+	traffic.llc_to_memory++;
+	int n = llc_memory_writeback_count++;
+	if (llc_memory_writebacks) {
+		assert (n < MAX_MEMORY_WRITEBACKS);
+		llc_memory_writebacks[n] = block;
+	}
+	return MISS_L3_WRITEBACK | (n ? MISS_L3_2ND_WRITEBACK : 0);
+}
+
+// after a fill in the LLC: write back its victim and enforce inclusion
+
+static unsigned int llc_evicted (cache *L1, cache *L2, cache *L3) {
+	unsigned int miss = 0;
+	if (!L3->evicted) return 0;
+	unsigned long long int victim = L3->evicted_address;
+	bool dirty = L3->evicted_dirty;
+	if (inclusion == INCLUSION_INCLUSIVE) {
+		// the core id exclusiu keeps in the top address bits says whose caches
+		// to look in; with a shared address space the directory does
+
+		unsigned int owners = coherence ? directory_sharers (coherence, victim >> L3->offset_bits) : 1u << (victim >> 56);
+		traffic.back_invalidations++;
+		for (unsigned int owner=0; owners; owner++, owners >>= 1) if (owners & 1) {
+			unsigned long long int before = L1[owner].invalidations + L2[owner].invalidations;
+			bool d1 = invalidate (&L1[owner], victim);
+			bool d2 = invalidate (&L2[owner], victim);
+			traffic.back_invalidated_blocks += L1[owner].invalidations + L2[owner].invalidations - before;
+			if (d1 || d2) {
+				traffic.back_invalidated_dirty++;
+				dirty = true;
+			}
+		}
+	}
+	if (dirty) miss |= llc_to_memory (victim);
+	return miss;
+}
+
+// a dirty victim from the L2 goes into the LLC
+
+static unsigned int l2_evicted (cache *L1, cache *L2, cache *L3, unsigned long long int wb, const block_meta *meta, unsigned long long int pc, unsigned int size, unsigned int core) {
+	if (!wb || !meta->dirty) return 0;
+	unsigned int miss = MISS_L2_WRITEBACK;
+	traffic.l2_to_llc++;
+	unsigned long long int wbl3;
+	(void) cache_access (L3, wb, pc, size, DAN_WRITEBACK, core, &wbl3, true, ACCESS_5, NULL, meta);
+
+	// a block the LLC bypassed comes straight back out, still dirty
+
+	if (wbl3 && !L3->evicted) return miss | llc_to_memory (wbl3);
+	return miss | llc_evicted (L1, L2, L3);
+}
+
+static unsigned int memory_access_layered (cache *L1, cache *L2, cache *L3, unsigned long long int address, unsigned long long int pc, unsigned int size, int op, unsigned int core, unsigned int remote) {
+	unsigned int miss = 0;
+	unsigned long long int wbl1, wbl2;
+	block_meta metal1, metal2;
+
+	// the levels below only get a clean copy; a store dirties the L1's
+
+	int fill_op = op == DAN_WRITE ? DAN_DREAD : op;
+	if (!cache_access (&L1[core], address, pc, size, op, core, &wbl1, true, ACCESS_1, &metal1)) return 0;
+	miss |= MISS_L1_DEMAND;
+	if (cache_access (&L2[core], address, pc, size, fill_op, core, &wbl2, true, ACCESS_2, &metal2)) {
+		miss |= MISS_L2_DEMAND;
+		unsigned long long int wbl3;
+		if (cache_access (L3, address, pc, size, fill_op, core, &wbl3, true, ACCESS_3)) {
+			if (remote) miss |= MISS_REMOTE;
+			else {
+				miss |= MISS_L3_DEMAND | MISS_MEMORY;
+				traffic.memory_reads++;
+			}
+		}
+		miss |= llc_evicted (L1, L2, L3);
+	}
+	miss |= l2_evicted (L1, L2, L3, wbl2, &metal2, pc, size, core);
+
+	// a dirty L1 victim is written into the L2, which may evict in turn
+
+	if (wbl1 && metal1.dirty) {
+		miss |= MISS_L1_WRITEBACK;
+		traffic.l1_to_l2++;
+		(void) cache_access (&L2[core], wbl1, pc, size, DAN_WRITEBACK, core, &wbl2, true, ACCESS_4, &metal2, &metal1);
+		miss |= l2_evicted (L1, L2, L3, wbl2, &metal2, pc, size, core);
+	}
+	return miss;
+}
+
+// is the block in this cache? a lookup that changes nothing and counts nothing
+
+static bool holds (cache *c, unsigned long long int address) {
+	unsigned long long int block_addr = address >> c->offset_bits;
+	unsigned long long int tag = index_tag (c, block_addr);
+	block *v = &c->blocks[(size_t) index_set (c, block_addr) * c->assoc];
+	for (int i=0; i<c->assoc; i++) {
+		if (c->index_fn == INDEX_SKEW) v = &c->blocks[(size_t) index_set (c, block_addr, i) * c->assoc];
+		if (v[i].valid && v[i].tag == tag) return true;
+	}
+	return false;
+}
+
+// let the prefetchers see a demand access that reached their level and
+// fetch what they propose. a block already in the core's L1 or L2 (or, for
+// the LLC's prefetcher, the LLC), or held by another core in a shared
+// address space, isn't fetched. an L2 prefetch comes from the LLC if it is
+// there, moving up in the exclusive hierarchy, and from memory otherwise.
+// the victims go down the same way a demand fill's do. prefetch traffic is
+// counted but the timing model doesn't see it.
+
+static void issue_prefetches (cache *L1, cache *L2, cache *L3, unsigned long long int address, unsigned long long int pc, unsigned int size, unsigned int core, unsigned int miss) {
+	unsigned long long int cand[PREFETCH_MAX_DEGREE];
+	for (int level=LEVEL_L2; level<=LEVEL_LLC; level++) {
+		prefetcher *p = level == LEVEL_L2 ? L2[core].pf : L3->pf;
+		if (!p || !(miss & (level == LEVEL_L2 ? MISS_L1_DEMAND : MISS_L2_DEMAND))) continue;
+		bool missed = miss & (level == LEVEL_L2 ? MISS_L2_DEMAND : MISS_MEMORY | MISS_REMOTE);
+		int n = prefetcher_train (p, address, pc, core, missed, cand);
+		for (int k=0; k<n; k++) {
+			unsigned long long int a = cand[k], wbl2, wbl3;
+			block_meta metal2, moved;
+			if (holds (&L1[core], a) || holds (&L2[core], a) || (level == LEVEL_LLC && holds (L3, a))) continue;
+			if (coherence && (directory_sharers (coherence, a >> L3->offset_bits) & ~(1u << core))) continue;
+			bool from_memory;
+			int source = level == LEVEL_L2 ? ACCESS_PF_L2 : ACCESS_PF_LLC;
+			if (inclusion == INCLUSION_EXCLUSIVE) {
+				if (level == LEVEL_L2) {
+					from_memory = cache_extract (L3, a, pc, size, DAN_PREFETCH, core, source, &moved);
+				} else {
+					from_memory = true;
+					(void) cache_access (L3, a, pc, size, DAN_PREFETCH, core, &wbl3, true, source);
+					if (wbl3) traffic.llc_to_memory++;
+				}
+			} else {
+				from_memory = cache_access (L3, a, pc, size, DAN_PREFETCH, core, &wbl3, true, source);
+				(void) llc_evicted (L1, L2, L3);
+			}
+			if (level == LEVEL_L2) {
+				// a block moved up from the LLC keeps its metadata, dirty bit and all
+
+				bool moved_up = inclusion == INCLUSION_EXCLUSIVE && !from_memory;
+				(void) cache_access (&L2[core], a, pc, size, DAN_PREFETCH, core, &wbl2, true, source, &metal2, moved_up ? &moved : NULL);
+				if (inclusion != INCLUSION_EXCLUSIVE) (void) l2_evicted (L1, L2, L3, wbl2, &metal2, pc, size, core);
+				else if (wbl2) {
+					traffic.l2_to_llc++;
+					(void) cache_access (L3, wbl2, pc, size, DAN_WRITEBACK, core, &wbl3, true, ACCESS_5, NULL, &metal2);
+					if (wbl3) traffic.llc_to_memory++;
+				}
+			}
+			if (from_memory) traffic.prefetch_reads++;
+			prefetcher_issued (p, a, from_memory);
+		}
+	}
+}
+
+unsigned int memory_access (cache *L1, cache *L2, cache *L3, unsigned long long int address, unsigned long long int pc, unsigned int size, int op, unsigned int core, unsigned long long int *memory_writebacks) {
 	// access the memory hierarchy, returning latency of access
 	unsigned int miss = 0;
+	if (memory_writebacks) memset (memory_writebacks, 0, sizeof (*memory_writebacks) * MAX_MEMORY_WRITEBACKS);
+	llc_memory_writebacks = memory_writebacks;
+	llc_memory_writeback_count = 0;
+
+	// with a shared address space, the other cores' copies come first
+
+	unsigned int remote = coherence ? coherence_access (coherence, L1, L2, address, op, core) & COHERENCE_REMOTE : 0;
+	if (inclusion != INCLUSION_EXCLUSIVE) {
+		miss = memory_access_layered (L1, L2, L3, address, pc, size, op, core, remote);
+		llc_memory_writebacks = NULL;
+		if (op != DAN_PREFETCH) issue_prefetches (L1, L2, L3, address, pc, size, core, miss);
+		return miss;
+	}
 
 	unsigned long long int wbl1;
-	unsigned int missL1 = cache_access (&L1[core], address, pc, size, op, core, &wbl1, true, ACCESS_1);
-        if (missL1) {
-                miss |= MISS_L1_DEMAND;
-		unsigned long long int wbl2;
+	block_meta metal1, moved;
+	const block_meta *fill_meta = NULL;
 
-		// see if the block is in the L2, but don't place it there if not
+	// on an L1 miss the block moves up: take it out of the L2 if it is there,
+	// and otherwise out of the shared LLC. neither places it on a miss. this
+	// comes before the L1 fill so the block arrives with what it did below,
+	// dirty bit included; one from memory or another core is new
 
-		unsigned int missL2 = cache_access (&L2[core], address, pc, size, op, core, &wbl2, false, ACCESS_2);
+	bool hitL1 = holds (&L1[core], address);
+	if (!hitL1) {
+		unsigned int missL2 = cache_extract (&L2[core], address, pc, size, op, core, ACCESS_2, &moved);
 		if (missL2) {
 			miss |= MISS_L2_DEMAND;
-			unsigned long long int wbl3;
-			// see if the block is in the shared LLC, but don't place it there if not
-			bool missL3 = cache_access (L3, address, pc, size, op, core, &wbl3, false, ACCESS_3);
-			if (missL3) miss |= MISS_L3_DEMAND;
-			// if it is there, we need to invalidate out of the L2 and L3 for the L1 demand access
-			invalidate (L3, address);
-			invalidate (L2, address);
-		} else {
-			// no miss from L2; invalidate this out of the L2 if it is there
-			invalidate (L2, address);
-		}
+			bool missL3 = cache_extract (L3, address, pc, size, op, core, ACCESS_3, &moved);
+			if (missL3 && remote) miss |= MISS_REMOTE;
+			else if (missL3) {
+				miss |= MISS_L3_DEMAND | MISS_MEMORY;
+				traffic.memory_reads++;
+			}
+			if (!missL3) fill_meta = &moved;
+		} else fill_meta = &moved;
+	}
+	unsigned int missL1 = cache_access (&L1[core], address, pc, size, op, core, &wbl1, true, ACCESS_1, &metal1, fill_meta);
+	assert (!missL1 == hitL1);
+        if (missL1) {
+                miss |= MISS_L1_DEMAND;
 		if (wbl1) {
 			miss |= MISS_L1_WRITEBACK;
+			traffic.l1_to_l2++;
 			// generate a writeback to L2
 			unsigned long long int wbl2;
-			// place this L1 victim in the L2
-			(void) cache_access (&L2[core], wbl1, pc, size, DAN_WRITEBACK, core, &wbl2, true, ACCESS_4);
+			block_meta metal2;
+			// place this L1 victim in the L2, along with what it did in the L1
+			(void) cache_access (&L2[core], wbl1, pc, size, DAN_WRITEBACK, core, &wbl2, true, ACCESS_4, &metal2, &metal1);
 			if (wbl2) {
 				// this writeback generated its own writeback
 				miss |= MISS_L2_WRITEBACK;
+				traffic.l2_to_llc++;
 				unsigned long long int wbl3;
-				// place this L2 victim in the LLC
-				unsigned int missL3 = cache_access (L3, wbl2, pc, size, DAN_WRITEBACK, core, &wbl3, true, ACCESS_5);
-				if (wbl3) miss |= MISS_L3_WRITEBACK;
+				// place this L2 victim in the LLC; the policy may bypass it, in which
+				// case a dirty victim comes back out as a writeback to memory
+				unsigned int missL3 = cache_access (L3, wbl2, pc, size, DAN_WRITEBACK, core, &wbl3, true, ACCESS_5, NULL, &metal2);
+				if (wbl3) miss |= llc_to_memory (wbl3);
 				// what if we missed didn't write back to DRAM?
 				if (missL3) miss |= MISS_L3_DEMAND;
 			}
 		}
-		if (wbl2) {
-			// generate a writeback to L3
-			if (miss & MISS_L2_WRITEBACK) miss |= MISS_L2_2ND_WRITEBACK; else miss |= MISS_L2_WRITEBACK;
-			unsigned long long int wbl3;
-			unsigned int missL3 = cache_access (L3, wbl2, pc, size, DAN_WRITEBACK, core, &wbl3, true, ACCESS_6);
-			if (missL3) { if (miss & MISS_L3_WRITEBACK) miss |= MISS_L3_2ND_WRITEBACK; } else miss |= MISS_L3_WRITEBACK;
-		}
 	}
+	llc_memory_writebacks = NULL;
+	if (op != DAN_PREFETCH) issue_prefetches (L1, L2, L3, address, pc, size, core, miss);
 	return miss;
 }
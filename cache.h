@@ -1,7 +1,7 @@
 // quick and dirty cache simulation
 
 #define MAX_SETS	(1<<19)
-#define MAX_ASSOC	16
+#define MAX_ASSOC	64
 #define WORDSIZE	4
 
 #define DAN_IREAD       0
@@ -30,7 +30,30 @@
 #define MISS_L2_WRITEBACK       0x0010
 #define MISS_L3_WRITEBACK       0x0020
 #define MISS_L2_2ND_WRITEBACK   0x0040
-#define MISS_L3_2ND_WRITEBACK   0x0040
+#define MISS_L3_2ND_WRITEBACK   0x0200
+#define MISS_MEMORY             0x0080	// the demand access itself was served by memory
+#define MISS_REMOTE             0x0100	// ... by another core's private cache instead (DAN_SHARED)
+
+// the most blocks one access can write back from the LLC to memory: in the
+// inclusive and non-inclusive hierarchies, the LLC's victim from the fill
+// and one for each of the two dirty L2 victims the LLC can take in
+#define MAX_MEMORY_WRITEBACKS	3
+
+// how the levels share blocks: exclusive (the default) keeps every block in
+// exactly one level, inclusive keeps a copy in the LLC of everything in the
+// L1s and L2s, and non-inclusive (NINE) fills every level and evicts each
+// on its own
+
+#define INCLUSION_EXCLUSIVE	0
+#define INCLUSION_INCLUSIVE	1
+#define INCLUSION_NINE		2
+
+// which level a cache is. the LLC only writes back dirty victims; the levels
+// above send every victim down, which is what makes the hierarchy exclusive
+
+#define LEVEL_L1		1
+#define LEVEL_L2		2
+#define LEVEL_LLC		3
 
 #define ACCESS_1		1	// first access to L1
 #define ACCESS_2		2	// access to L2 on L1 miss
@@ -38,6 +61,8 @@
 #define ACCESS_4		4	// writeback to L2 on eviction from L1
 #define ACCESS_5		5	// writeback to L3 on eviction from L2
 #define ACCESS_6		6	// second writeback to L3 on eviction from L2
+#define ACCESS_PF_L2		7	// prefetch from the L2's prefetcher
+#define ACCESS_PF_LLC		8	// prefetch from the LLC's prefetcher
 
 struct block {
 	unsigned int lru_stack_position;
@@ -45,34 +70,150 @@ struct block {
 	unsigned char valid, dirty;
 	unsigned long long int filling_pc; // pc that filled this block
 	int offset; // offset of *byte* that caused this line to be filled
+	unsigned char prefetched; // filled by a prefetch, no demand hit since
+	unsigned int signature; // hashed filling pc
+	unsigned int hits; // hits at this level since placement
+	unsigned int reuse; // reuse history carried from other levels
+	unsigned long long int last_use; // access clock at the last use, for LRU in a skewed cache
+	unsigned char rewritten; // dirty and written or reused again since placement
 
 	block (void) {
 		offset = 0;
+		prefetched = false;
+		signature = 0;
+		hits = 0;
+		reuse = 0;
 		dirty = false;
 		valid = false;
 		tag = 0;
+		last_use = 0;
+		rewritten = false;
 	}
 };
 
 struct set {
-	block blocks[MAX_ASSOC];
+	block *blocks; // assoc blocks, in one array for the whole cache
 	unsigned char valid; // means entire set is valid
 
 	set (void) {
+		blocks = NULL;
 		valid = false;
-		for (int i=0; i<MAX_ASSOC; i++) {
-			blocks[i].lru_stack_position = i;
-		}
 	}
 };
 
+// what a block takes with it to another level: an evicted block going down,
+// or in the exclusive hierarchy a block moving up. this lets the other
+// level's policy see where the block came from instead of the pc of
+// whatever access happened to move it. a layered hierarchy refills the
+// upper levels from a copy, so those fills start over with the access's pc
+
+struct block_meta {
+	unsigned long long int filling_pc; // pc whose fill started this metadata
+	unsigned int signature; // hashed filling pc
+	unsigned int hits; // hits in the level it left
+	unsigned int reuse; // (reuse << 1) | (hits > 0) each time it leaves a level
+	bool prefetched; // filled by a prefetch, no demand hit yet
+	bool dirty;
+};
+
+// signature of a pc, the same at every level
+
+static inline unsigned int pc_signature (unsigned long long int pc) {
+	return (unsigned int) ((pc ^ (pc >> 16) ^ (pc >> 32)) & 0xffff);
+}
+
+// how a cache maps a block address to a set. the tag is whatever the index
+// leaves out, so a tag and its set always give back the block address
+// exactly (index_block), whichever function is used
+
+#define INDEX_MODULO	0	// the low bits of the block address, above set_shift of them
+#define INDEX_XOR	1	// the low bits xor the tag folded down to index_bits
+#define INDEX_PRIME	2	// the block address modulo the largest prime <= nsets
+#define INDEX_SKEW	3	// skewed-associative: each way xors in its own hash of the tag
+
+static inline unsigned int fold_tag (unsigned long long int tag, int bits, unsigned int mask) {
+	unsigned long long int h = 0;
+	if (bits) for (; tag; tag >>= bits) h ^= tag;
+	return (unsigned int) h & mask;
+}
+
+static inline unsigned int skew_hash (unsigned long long int tag, int way, unsigned int mask) {
+	return (unsigned int) (((tag + way) * 0x9e3779b97f4a7c15ull) >> 32) & mask;
+}
+
+// these work on a cache or a fast_cache; way only matters in a skewed cache
+
+template <class C>
+static inline unsigned long long int index_tag (const C *c, unsigned long long int block_addr) {
+	switch (c->index_fn) {
+		case INDEX_PRIME: return block_addr / c->index_prime;
+		case INDEX_XOR:
+		case INDEX_SKEW: return block_addr >> c->index_bits;
+
+		// the set_shift bits below the index are part of the tag
+
+		default: return ((block_addr >> (c->set_shift + c->index_bits)) << c->set_shift) | (block_addr & ((1ull << c->set_shift) - 1));
+	}
+}
+
+template <class C>
+static inline unsigned int index_set (const C *c, unsigned long long int block_addr, int way = 0) {
+	switch (c->index_fn) {
+		case INDEX_XOR: return (block_addr ^ fold_tag (block_addr >> c->index_bits, c->index_bits, c->index_mask)) & c->index_mask;
+		case INDEX_PRIME: return (unsigned int) (block_addr % c->index_prime);
+		case INDEX_SKEW: return (block_addr ^ skew_hash (block_addr >> c->index_bits, way, c->index_mask)) & c->index_mask;
+		default: return (block_addr >> c->set_shift) & c->index_mask;
+	}
+}
+
+template <class C>
+static inline unsigned long long int index_block (const C *c, unsigned long long int tag, unsigned int set, int way = 0) {
+	switch (c->index_fn) {
+		case INDEX_XOR: return (tag << c->index_bits) | ((set ^ fold_tag (tag, c->index_bits, c->index_mask)) & c->index_mask);
+		case INDEX_PRIME: return tag * c->index_prime + set;
+		case INDEX_SKEW: return (tag << c->index_bits) | ((set ^ skew_hash (tag, way, c->index_mask)) & c->index_mask);
+		default: {
+			unsigned long long int low = tag & ((1ull << c->set_shift) - 1);
+			return ((tag >> c->set_shift) << (c->set_shift + c->index_bits)) | ((unsigned long long int) set << c->set_shift) | low;
+		}
+	}
+}
+
+struct fast_cache;
+struct ucp_state;
+struct directory;
+struct prefetcher;
+struct pc_profile;
+
 struct cache {
-	int	nsets, assoc, blocksize, set_shift;
+	int	nsets, assoc, blocksize, set_shift, level;
 	int	offset_bits, index_bits, replacement_policy, tagshiftbits;
 	unsigned int index_mask;
+	int	index_fn; // INDEX_MODULO etc.
+	unsigned int index_prime; // sets used with INDEX_PRIME
 	unsigned long long misses, accesses, invalidations;
+	unsigned long long pf_fills, pf_useful, pf_useless; // prefetch-fill usefulness
+	unsigned long long fills, bypasses, bypass_dirty, bypass_reused; // bypass rate and accuracy
+	unsigned long long *bypass_shadow; // recently bypassed block addresses, to catch bad bypasses
 	set	*sets;
+	block	*blocks; // all the sets' blocks, nsets * assoc of them
 	long long int counts[DAN_MAX];
+	unsigned long long int *set_misses; // misses per set, if counted
+	unsigned long long int clock; // accesses, as a timestamp for skewed LRU
+	int	last_way; // way of the last hit or fill, -1 for a miss without one
+	bool	evicted, evicted_dirty; // the last fill replaced a valid block, and whether it was dirty
+	unsigned long long int evicted_address; // that block's address
+	unsigned long long int evicted_pc; // ... the pc that filled it
+	unsigned int evicted_hits; // ... and its hits while here
+	fast_cache *lockstep; // second engine checked against this one (DAN_DIFF), or NULL
+	ucp_state *ucp; // way partitioning among cores (DAN_UCP), or NULL
+	directory *dir; // coherence directory this private cache reports to (DAN_SHARED), or NULL
+	int	write_window; // LRU positions searched for a clean victim (DAN_WRITE_AWARE), 0 for plain LRU
+	unsigned char *rewrite_pred; // per-signature counters: do dirty blocks get rewritten?
+	unsigned long long dirty_spared; // victims moved off a dirty block by the write-aware policy
+	int	dir_bit; // its bit in the directory's presence vectors
+	prefetcher *pf; // prefetcher watching the demand accesses to this level, or NULL
+	pc_profile *prof; // per-pc profile of sampled sets (DAN_PROFILE), or NULL
 
 	CACHE_REPLACEMENT_STATE *repl;
 
@@ -80,11 +221,62 @@ struct cache {
 		misses = 0;
 		accesses = 0;
 		index_mask = 0;
+		index_fn = INDEX_MODULO;
+		index_prime = 0;
+		set_misses = NULL;
+		clock = 0;
 		invalidations = 0;
+		pf_fills = 0;
+		pf_useful = 0;
+		pf_useless = 0;
+		fills = 0;
+		bypasses = 0;
+		bypass_dirty = 0;
+		bypass_reused = 0;
+		bypass_shadow = NULL;
+		last_way = -1;
+		evicted = false;
+		evicted_dirty = false;
+		evicted_address = 0;
+		evicted_pc = 0;
+		evicted_hits = 0;
+		lockstep = NULL;
+		ucp = NULL;
+		dir = NULL;
+		dir_bit = 0;
+		pf = NULL;
+		prof = NULL;
+		write_window = 0;
+		rewrite_pred = NULL;
+		dirty_spared = 0;
+		blocks = NULL;
 		repl = NULL;
 	}
 };
 
-void init_cache (cache *c, int nsets, int assoc, int blocksize, int policy, int set_shift);
-bool cache_access (cache *c, unsigned long long int address, unsigned long long int, unsigned int, int op, unsigned int core);
-unsigned int memory_access (cache *l1, cache *l2, cache *l3, unsigned long long int address, unsigned long long int, unsigned int, int op, unsigned int);
+void init_cache (cache *c, int nsets, int assoc, int blocksize, int policy, int set_shift, int level);
+bool cache_access (cache *c, unsigned long long int address, unsigned long long int, unsigned int, int op, unsigned int core, unsigned long long int *writeback_address = NULL, bool do_place = true, int access_source = 0, block_meta *writeback_meta = NULL, const block_meta *fill_meta = NULL);
+bool cache_extract (cache *c, unsigned long long int address, unsigned long long int pc, unsigned int size, int op, unsigned int core, int access_source = 0, block_meta *meta = NULL);
+bool invalidate (cache *c, unsigned long long int address);
+void set_index_function (cache *c, int index_fn);
+void set_write_aware (cache *c, int window);
+void count_set_misses (cache *c);
+void fill_state (cache *c, double *full_sets, double *valid_blocks);
+void print_set_pressure (cache *c, const char *name);
+void move_to_mru (block *v, int i);
+unsigned int memory_access (cache *l1, cache *l2, cache *l3, unsigned long long int address, unsigned long long int, unsigned int, int op, unsigned int, unsigned long long int *memory_writebacks = NULL);
+
+// writebacks and invalidations between the levels, for comparing inclusion policies
+
+struct hierarchy_traffic {
+	unsigned long long int memory_reads; // demand misses in every level
+	unsigned long long int prefetch_reads; // prefetches issued by the L2 and LLC prefetchers that memory served
+	unsigned long long int l1_to_l2, l2_to_llc, llc_to_memory; // victims sent down
+	unsigned long long int back_invalidations; // LLC victims invalidated out of an L1 and L2
+	unsigned long long int back_invalidated_blocks; // upper-level copies they removed
+	unsigned long long int back_invalidated_dirty; // of those, dirty ones written to memory
+};
+
+extern int inclusion;
+extern hierarchy_traffic traffic;
+extern directory *coherence; // the directory for a shared address space, NULL if cores don't share
@@ -0,0 +1,173 @@
+// the coherence directory (see coherence.h)
+
+#include <stdio.h>
+#include <string.h>
+#include "utils.h"
+#include "replacement_state.h"
+#include "cache.h"
+#include "coherence.h"
+
+#define CORE_MASK	((1u << DIRECTORY_MAX_CORES) - 1)
+
+// the cores with a copy in their L1 or L2
+
+static inline unsigned int sharers_of (unsigned int present) {
+	return (present | (present >> DIRECTORY_L2_BIT)) & CORE_MASK;
+}
+
+static inline unsigned int slot_of (directory *d, unsigned long long int block_addr) {
+	return (unsigned int) ((block_addr * 0x9e3779b97f4a7c15ull) >> 32) & (d->size - 1);
+}
+
+static void alloc_table (directory *d, unsigned int size) {
+	d->size = size;
+	d->table = new directory_entry[size];
+	memset (d->table, 0, sizeof (directory_entry) * size);
+}
+
+directory *new_directory (int initial_blocks) {
+	directory *d = new directory;
+	unsigned int size = 1024;
+	while (size < 2u * initial_blocks) size *= 2;
+	alloc_table (d, size);
+	d->used = d->max_used = 0;
+	d->writes_shared = 0;
+	d->invalidation_messages = 0;
+	d->invalidated_blocks = d->invalidated_dirty = 0;
+	d->coherence_misses = 0;
+	d->remote_hits = 0;
+	d->interventions = 0;
+	return d;
+}
+
+// the entry for a block, or NULL if no private cache has it
+
+static directory_entry *lookup (directory *d, unsigned long long int block_addr) {
+	for (unsigned int s=slot_of (d, block_addr);; s=(s+1) & (d->size - 1)) {
+		directory_entry *e = &d->table[s];
+		if (e->block == block_addr + 1) return e;
+		if (!e->block) return NULL;
+	}
+}
+
+static void grow (directory *d) {
+	directory_entry *old = d->table;
+	unsigned int old_size = d->size;
+	alloc_table (d, old_size * 2);
+	for (unsigned int i=0; i<old_size; i++) if (old[i].block) {
+		unsigned int s = slot_of (d, old[i].block - 1);
+		while (d->table[s].block) s = (s+1) & (d->size - 1);
+		d->table[s] = old[i];
+	}
+	delete[] old;
+}
+
+static directory_entry *find_or_add (directory *d, unsigned long long int block_addr) {
+	directory_entry *e = lookup (d, block_addr);
+	if (e) return e;
+	if (2 * (d->used + 1) > d->size) grow (d);
+	unsigned int s = slot_of (d, block_addr);
+	while (d->table[s].block) s = (s+1) & (d->size - 1);
+	e = &d->table[s];
+	e->block = block_addr + 1;
+	e->present = 0;
+	e->lost = 0;
+	e->owner = -1;
+	if (++d->used > d->max_used) d->max_used = d->used;
+	return e;
+}
+
+// take an entry out, moving later entries of its probe run back so lookups
+// still find them without tombstones
+
+static void erase (directory *d, directory_entry *e) {
+	unsigned int mask = d->size - 1;
+	unsigned int hole = e - d->table;
+	d->table[hole].block = 0;
+	d->used--;
+	for (unsigned int s=(hole+1) & mask; d->table[s].block; s=(s+1) & mask) {
+		unsigned int home = slot_of (d, d->table[s].block - 1);
+
+		// move it if its home isn't cyclically in (hole, s]
+
+		if (((s - home) & mask) >= ((s - hole) & mask)) {
+			d->table[hole] = d->table[s];
+			d->table[s].block = 0;
+			hole = s;
+		}
+	}
+}
+
+// a private cache placed a block, or removed one; bit is the cache's bit in
+// the presence vector
+
+void directory_fill (directory *d, unsigned long long int block_addr, int bit) {
+	directory_entry *e = find_or_add (d, block_addr);
+	e->present |= 1u << bit;
+	e->lost &= ~(1u << (bit % DIRECTORY_L2_BIT));
+}
+
+void directory_drop (directory *d, unsigned long long int block_addr, int bit) {
+	directory_entry *e = lookup (d, block_addr);
+	if (!e) return;
+	e->present &= ~(1u << bit);
+	if (!e->present) erase (d, e);
+}
+
+// cores with a copy of a block, one bit each
+
+unsigned int directory_sharers (directory *d, unsigned long long int block_addr) {
+	directory_entry *e = lookup (d, block_addr);
+	return e ? sharers_of (e->present) : 0;
+}
+
+// a demand access by core, before it goes to the core's caches: do what
+// the protocol asks of the other cores and count it. L1 and L2 are the
+// arrays of every core's private caches. returns COHERENCE_REMOTE if
+// another core has a copy, so a private miss can be served from there.
+
+unsigned int coherence_access (directory *d, cache *L1, cache *L2, unsigned long long int address, int op, unsigned int core) {
+	unsigned long long int block_addr = address >> L1[core].offset_bits;
+	directory_entry *e = lookup (d, block_addr);
+	if (!e) return 0;
+	unsigned int me = 1u << core;
+	unsigned int others = sharers_of (e->present) & ~me;
+	if (!(sharers_of (e->present) & me)) {
+		if (e->lost & me) d->coherence_misses++;
+		if (others) d->remote_hits++;
+	}
+	e->lost &= ~me;
+	if (op == DAN_WRITE) {
+		if (others) {
+			d->writes_shared++;
+
+			// invalidate drops the copies from the directory, which may
+			// remove the entry, so it is looked up again afterwards
+
+			for (unsigned int k=0; k<DIRECTORY_MAX_CORES; k++) if (others & (1u << k)) {
+				d->invalidation_messages++;
+				unsigned long long int before = L1[k].invalidations + L2[k].invalidations;
+				bool d1 = invalidate (&L1[k], address);
+				bool d2 = invalidate (&L2[k], address);
+				d->invalidated_blocks += L1[k].invalidations + L2[k].invalidations - before;
+				if (d1 || d2) d->invalidated_dirty++;
+			}
+			e = find_or_add (d, block_addr);
+			e->lost |= others;
+		}
+		e->owner = core;
+	} else if (e->owner >= 0 && e->owner != (int) core) {
+		// the writer's copy is downgraded to shared; its dirty data stays with it
+
+		d->interventions++;
+		e->owner = -1;
+	}
+	return others ? COHERENCE_REMOTE : 0;
+}
+
+void directory_print_stats (directory *d) {
+	printf ("coherence: writes to shared blocks: %lld invalidation messages: %lld removing %lld blocks, %lld dirty\n",
+		d->writes_shared, d->invalidation_messages, d->invalidated_blocks, d->invalidated_dirty);
+	printf ("coherence misses: %lld misses on blocks another core has: %lld interventions: %lld directory peak: %u blocks\n",
+		d->coherence_misses, d->remote_hits, d->interventions, d->max_used);
+}
@@ -0,0 +1,60 @@
+// a coherence directory for the shared-address mode (DAN_SHARED)
+//
+// normally exclusiu puts the core id in address bits 56 and up, so no two
+// cores ever share a block. with DAN_SHARED the traces are threads of one
+// process and keep their addresses, so a block can be in several cores'
+// private caches at once. the directory keeps, for each block in any L1 or
+// L2, a presence vector: bit c for core c's L1 and bit 16 + c for its L2.
+// the private caches keep it up to date as they fill, evict and invalidate.
+//
+// memory_access asks the directory first (coherence_access). a write
+// invalidates every other core's copies, MSI style; a read of a block
+// another core has written since is an intervention; a private miss on a
+// block another core holds that the LLC doesn't have is served from that
+// core's cache (MISS_REMOTE) instead of memory; and a private miss on a
+// block this core lost to an invalidation is a coherence miss, as long as
+// some cache still has the block. the LLC is the point of coherence and
+// keeps its copy, which the next writeback of the block updates.
+//
+// the table is open addressing with linear probing, sized to the private
+// caches and grown when it gets half full; entries leave when their last
+// copy does.
+
+#ifndef __COHERENCE_H
+#define __COHERENCE_H
+
+#define DIRECTORY_MAX_CORES	16
+#define DIRECTORY_L2_BIT	16	// bit of core 0's L2 in the presence vector
+
+struct cache;
+
+struct directory_entry {
+	unsigned long long int block;	// block address + 1, 0 if empty
+	unsigned int present;		// L1 and L2 copies, as above
+	unsigned short lost;		// cores whose copies a write invalidated
+	signed char owner;		// core that last wrote it, -1 if read since
+};
+
+struct directory {
+	directory_entry *table;
+	unsigned int size, used, max_used;
+	unsigned long long int writes_shared;	// writes that found other cores' copies
+	unsigned long long int invalidation_messages; // one per other core with a copy
+	unsigned long long int invalidated_blocks, invalidated_dirty; // copies those removed
+	unsigned long long int coherence_misses; // private misses on blocks lost to invalidation
+	unsigned long long int remote_hits;	// private misses on blocks another core has
+	unsigned long long int interventions;	// reads of a block another core had written
+};
+
+// what coherence_access found, for memory_access
+
+#define COHERENCE_REMOTE	1	// another core has a copy to send
+
+directory *new_directory (int initial_blocks);
+void directory_fill (directory *d, unsigned long long int block_addr, int bit);
+void directory_drop (directory *d, unsigned long long int block_addr, int bit);
+unsigned int directory_sharers (directory *d, unsigned long long int block_addr);
+unsigned int coherence_access (directory *d, cache *L1, cache *L2, unsigned long long int address, int op, unsigned int core);
+void directory_print_stats (directory *d);
+
+#endif
@@ -0,0 +1,303 @@
+// chunked trace format
+//
+// gzip traces can't be seeked and spend most of their bytes on 64-bit
+// fields that only change by small amounts. this format keeps the same
+// trace records but:
+//
+// - encodes each field as a zigzag varint delta from the previous record
+// - cuts the stream into chunks of CTRACE_CHUNK_RECORDS records, each
+//   compressed on its own with the delta base reset to zero, so any chunk
+//   can be decoded without the ones before it
+// - ends with an index of (first instruction count, file offset) per chunk,
+//   so a reader can start at any instruction count
+//
+// layout:
+//	header:	u32 magic, u32 version, u32 chunk records, u32 reserved
+//	chunk:	u32 compressed size, u32 raw size, u32 records, deflated bytes
+//	index:	per chunk u64 first instr, u64 file offset, u32 records
+//	footer:	u64 index offset, u32 number of chunks, u32 magic
+//
+// records hold the raw command from the original trace (CMP$im encoding);
+// tracereader translates it exactly as it does for gzip traces.
+
+#ifndef __CTRACE_H
+#define __CTRACE_H
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <zlib.h>
+#include <vector>
+
+#define CTRACE_MAGIC		0x43525458	// "XTRC"
+#define CTRACE_VERSION		1
+#define CTRACE_CHUNK_RECORDS	65536
+
+struct ctrace_index_entry {
+	unsigned long long int first_instr;
+	unsigned long long int offset;
+	unsigned int nrecords;
+};
+
+// zigzag varints: small positive and negative deltas both take one or two bytes
+
+static inline void ctrace_put_varint (std::vector<unsigned char> &buf, unsigned long long int x) {
+	while (x >= 0x80) {
+		buf.push_back ((unsigned char) (x | 0x80));
+		x >>= 7;
+	}
+	buf.push_back ((unsigned char) x);
+}
+
+static inline void ctrace_put_delta (std::vector<unsigned char> &buf, unsigned long long int cur, unsigned long long int prev) {
+	long long int d = (long long int) (cur - prev);
+	ctrace_put_varint (buf, ((unsigned long long int) d << 1) ^ (unsigned long long int) (d >> 63));
+}
+
+static inline unsigned long long int ctrace_get_varint (const unsigned char *&p) {
+	unsigned long long int x = 0;
+	int shift = 0;
+	for (;;) {
+		unsigned char b = *p++;
+		x |= (unsigned long long int) (b & 0x7f) << shift;
+		if (!(b & 0x80)) return x;
+		shift += 7;
+	}
+}
+
+static inline unsigned long long int ctrace_get_delta (const unsigned char *&p, unsigned long long int prev) {
+	unsigned long long int z = ctrace_get_varint (p);
+	return prev + ((z >> 1) ^ (0 - (z & 1)));
+}
+
+// one record as deltas from the previous one; also used by tracereader's in-memory replay
+
+static inline void ctrace_encode (std::vector<unsigned char> &buf, const trace *t, const trace *prev) {
+	buf.push_back ((unsigned char) t->cmd);
+	ctrace_put_varint (buf, t->size);
+	ctrace_put_delta (buf, t->pc, prev->pc);
+	ctrace_put_delta (buf, t->address, prev->address);
+	ctrace_put_delta (buf, t->instr, prev->instr);
+	ctrace_put_delta (buf, t->cycle, prev->cycle);
+}
+
+static inline void ctrace_decode (const unsigned char *&p, trace *t, const trace *prev) {
+	t->cmd = *p++;
+	t->size = (unsigned int) ctrace_get_varint (p);
+	t->pc = ctrace_get_delta (p, prev->pc);
+	t->address = ctrace_get_delta (p, prev->address);
+	t->instr = ctrace_get_delta (p, prev->instr);
+	t->cycle = ctrace_get_delta (p, prev->cycle);
+}
+
+// encode and deflate n records as one chunk. callers that produce chunks in
+// parallel pack them here and hand them to ctrace_writer::write_packed in order
+
+static inline void ctrace_pack (const trace *t, unsigned int n, std::vector<unsigned char> &raw, std::vector<unsigned char> &packed, int level = Z_DEFAULT_COMPRESSION) {
+	trace prev;
+	memset (&prev, 0, sizeof (prev));
+	raw.clear ();
+	for (unsigned int i=0; i<n; i++) {
+		ctrace_encode (raw, &t[i], &prev);
+		prev = t[i];
+	}
+	uLongf len = compressBound (raw.size ());
+	packed.resize (len);
+	int r = compress2 (&packed[0], &len, &raw[0], raw.size (), level);
+	assert (r == Z_OK);
+	packed.resize (len);
+}
+
+// is this file a chunked trace?
+
+static inline bool ctrace_probe (const char *name) {
+	FILE *f = fopen (name, "r");
+	if (!f) return false;
+	unsigned int magic = 0;
+	bool yes = fread (&magic, sizeof (magic), 1, f) == 1 && magic == CTRACE_MAGIC;
+	fclose (f);
+	return yes;
+}
+
+class ctrace_writer {
+	FILE *fp;
+	std::vector<unsigned char> raw, packed;
+	std::vector<ctrace_index_entry> index;
+	trace prev;
+	unsigned int nrecords;
+	unsigned long long int first_instr;
+
+	void flush (void) {
+		if (!nrecords) return;
+		uLongf len = compressBound (raw.size ());
+		packed.resize (len);
+		int r = compress2 (&packed[0], &len, &raw[0], raw.size (), Z_DEFAULT_COMPRESSION);
+		assert (r == Z_OK);
+		packed.resize (len);
+		write_packed (first_instr, nrecords, raw.size (), packed);
+		raw.clear ();
+		nrecords = 0;
+	}
+
+public:
+
+	ctrace_writer (const char *name) {
+		fp = fopen (name, "w");
+		if (!fp) perror (name);
+		assert (fp);
+		unsigned int hdr[4] = { CTRACE_MAGIC, CTRACE_VERSION, CTRACE_CHUNK_RECORDS, 0 };
+		fwrite (hdr, sizeof (hdr), 1, fp);
+		nrecords = 0;
+		first_instr = 0;
+	}
+
+	// append a chunk made by ctrace_pack; must not be mixed with a partly filled write() chunk
+
+	void write_packed (unsigned long long int first, unsigned int n, size_t rawsize, const std::vector<unsigned char> &bytes) {
+		ctrace_index_entry e;
+		e.first_instr = first;
+		e.offset = ftello (fp);
+		e.nrecords = n;
+		index.push_back (e);
+		unsigned int hdr[3] = { (unsigned int) bytes.size (), (unsigned int) rawsize, n };
+		fwrite (hdr, sizeof (hdr), 1, fp);
+		fwrite (&bytes[0], 1, bytes.size (), fp);
+	}
+
+	// append a record in the raw (CMP$im) encoding
+
+	void write (const trace *t) {
+		if (nrecords == 0) {
+			memset (&prev, 0, sizeof (prev));
+			first_instr = t->instr;
+		}
+		ctrace_encode (raw, t, &prev);
+		prev = *t;
+		if (++nrecords == CTRACE_CHUNK_RECORDS) flush ();
+	}
+
+	void close (void) {
+		if (!fp) return;
+		flush ();
+		unsigned long long int index_offset = ftello (fp);
+		for (size_t i=0; i<index.size (); i++) {
+			fwrite (&index[i].first_instr, sizeof (index[i].first_instr), 1, fp);
+			fwrite (&index[i].offset, sizeof (index[i].offset), 1, fp);
+			fwrite (&index[i].nrecords, sizeof (index[i].nrecords), 1, fp);
+		}
+		unsigned int nchunks = index.size (), magic = CTRACE_MAGIC;
+		fwrite (&index_offset, sizeof (index_offset), 1, fp);
+		fwrite (&nchunks, sizeof (nchunks), 1, fp);
+		fwrite (&magic, sizeof (magic), 1, fp);
+		fclose (fp);
+		fp = NULL;
+	}
+
+	~ctrace_writer () {
+		close ();
+	}
+};
+
+class ctrace_reader {
+	FILE *fp;
+	std::vector<ctrace_index_entry> index;
+	std::vector<unsigned char> raw, packed;
+	std::vector<trace> records; // the decoded current chunk
+	size_t chunk, pos;
+
+	// decode chunk c into records; returns false past the last chunk
+
+	bool load (size_t c) {
+		records.clear ();
+		pos = 0;
+		chunk = c;
+		if (c >= index.size ()) return false;
+		fseeko (fp, index[c].offset, SEEK_SET);
+		unsigned int hdr[3];
+		if (fread (hdr, sizeof (hdr), 1, fp) != 1) return false;
+		packed.resize (hdr[0]);
+		raw.resize (hdr[1]);
+		if (fread (&packed[0], 1, hdr[0], fp) != hdr[0]) return false;
+		uLongf len = hdr[1];
+		int r = uncompress (&raw[0], &len, &packed[0], hdr[0]);
+		assert (r == Z_OK && len == hdr[1]);
+		records.resize (hdr[2]);
+		const unsigned char *p = &raw[0];
+		trace prev;
+		memset (&prev, 0, sizeof (prev));
+		for (unsigned int i=0; i<hdr[2]; i++) {
+			ctrace_decode (p, &records[i], &prev);
+			prev = records[i];
+		}
+		return true;
+	}
+
+public:
+
+	ctrace_reader (const char *name) {
+		fp = fopen (name, "r");
+		if (!fp) perror (name);
+		assert (fp);
+		unsigned int hdr[4];
+		if (fread (hdr, sizeof (hdr), 1, fp) != 1 || hdr[0] != CTRACE_MAGIC || hdr[1] != CTRACE_VERSION) {
+			fprintf (stderr, "%s: not a version %d chunked trace\n", name, CTRACE_VERSION);
+			assert (0);
+		}
+		unsigned long long int index_offset;
+		unsigned int nchunks, magic;
+		fseeko (fp, -16, SEEK_END);
+		if (fread (&index_offset, sizeof (index_offset), 1, fp) != 1
+			|| fread (&nchunks, sizeof (nchunks), 1, fp) != 1
+			|| fread (&magic, sizeof (magic), 1, fp) != 1 || magic != CTRACE_MAGIC) {
+			fprintf (stderr, "%s: chunked trace has no index (truncated?)\n", name);
+			assert (0);
+		}
+		index.resize (nchunks);
+		fseeko (fp, index_offset, SEEK_SET);
+		for (unsigned int i=0; i<nchunks; i++) {
+			ctrace_index_entry *e = &index[i];
+			if (fread (&e->first_instr, sizeof (e->first_instr), 1, fp) != 1
+				|| fread (&e->offset, sizeof (e->offset), 1, fp) != 1
+				|| fread (&e->nrecords, sizeof (e->nrecords), 1, fp) != 1) assert (0);
+		}
+		load (0);
+	}
+
+	// next record, or NULL at the end of the trace
+
+	trace *read (void) {
+		while (pos == records.size ()) {
+			if (!load (chunk + 1)) return NULL;
+		}
+		return &records[pos++];
+	}
+
+	void rewind (void) {
+		load (0);
+	}
+
+	// position the reader at the first record with at least instr instructions,
+	// decoding only the chunk that holds it
+
+	void seek (unsigned long long int instr) {
+		size_t lo = 0, hi = index.size ();
+		while (hi - lo > 1) {
+			size_t mid = (lo + hi) / 2;
+			if (index[mid].first_instr <= instr) lo = mid; else hi = mid;
+		}
+		load (lo);
+		while (pos < records.size () && records[pos].instr < instr) pos++;
+	}
+
+	unsigned long long int nrecords (void) {
+		unsigned long long int n = 0;
+		for (size_t i=0; i<index.size (); i++) n += index[i].nrecords;
+		return n;
+	}
+
+	~ctrace_reader () {
+		if (fp) fclose (fp);
+	}
+};
+
+#endif
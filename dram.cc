@@ -0,0 +1,171 @@
+// the DRAM model (see dram.h)
+
+#include <stdio.h>
+#include <string.h>
+#include "dram.h"
+
+using namespace std;
+
+void init_dram (dram *d, const dram_params *p) {
+	d->p = *p;
+	d->channels.resize (p->channels);
+	for (int i=0; i<p->channels; i++) {
+		dram_channel *ch = &d->channels[i];
+		ch->banks.resize (p->banks);
+		for (int j=0; j<p->banks; j++) {
+			ch->banks[j].open_row = -1;
+			ch->banks[j].busy_until = 0.0;
+		}
+		ch->bus_free = 0.0;
+		ch->bus_busy = 0.0;
+	}
+	d->reads = d->writes = d->drains = 0;
+	memset (d->row_hits, 0, sizeof (d->row_hits));
+	memset (d->row_empty, 0, sizeof (d->row_empty));
+	memset (d->row_conflicts, 0, sizeof (d->row_conflicts));
+	d->read_latency = 0.0;
+	d->last_time = 0.0;
+	d->clock = 0.0;
+	d->late = 0;
+}
+
+// the shared clock: arrivals never go back in time
+
+static double arrive (dram *d, double now) {
+	if (now < d->clock) {
+		d->late++;
+		return d->clock;
+	}
+	d->clock = now;
+	return now;
+}
+
+// channel, bank and row of a block: row | bank | column | channel | offset
+// with an open page, so a stream stays in a row; row | column | bank |
+// channel | offset with a closed page, so a stream spreads over the banks
+
+static void map (const dram *d, unsigned long long int address, int *channel, int *bank, long long int *row) {
+	unsigned long long int block = address / d->p.blocksize;
+	*channel = block % d->p.channels;
+	block /= d->p.channels;
+	if (d->p.closed_page) {
+		*bank = block % d->p.banks;
+		block /= d->p.banks;
+		*row = (long long int) (block / (d->p.row_bytes / d->p.blocksize));
+		return;
+	}
+	block /= d->p.row_bytes / d->p.blocksize;
+	*bank = block % d->p.banks;
+	*row = (long long int) (block / d->p.banks);
+}
+
+// do one access on its bank and the channel's bus, starting no earlier than now;
+// returns when its data has been transferred
+
+static double dram_do (dram *d, int channel, int bank, long long int row, double now, int write) {
+	dram_channel *ch = &d->channels[channel];
+	dram_bank *b = &ch->banks[bank];
+	double start = b->busy_until > now ? b->busy_until : now;
+	double t;
+	if (b->open_row == row) {
+		d->row_hits[write]++;
+		t = d->p.tCAS;
+	} else if (b->open_row == -1) {
+		d->row_empty[write]++;
+		t = d->p.tRCD + d->p.tCAS;
+	} else {
+		d->row_conflicts[write]++;
+		t = d->p.tRP + d->p.tRCD + d->p.tCAS;
+	}
+	double data = start + t;
+	if (ch->bus_free > data) data = ch->bus_free;
+	double done = data + d->p.tBURST;
+	ch->bus_free = done;
+	ch->bus_busy += d->p.tBURST;
+	if (d->p.closed_page) {
+		b->open_row = -1;
+		b->busy_until = done + d->p.tRP;
+	} else {
+		// the next column command to this row can follow one burst later
+		b->open_row = row;
+		b->busy_until = data - d->p.tCAS + d->p.tBURST;
+	}
+	if (done > d->last_time) d->last_time = done;
+	return done;
+}
+
+// empty a channel's write queue, writes to open rows first
+
+static void drain (dram *d, int channel, double now) {
+	dram_channel *ch = &d->channels[channel];
+	d->drains++;
+	while (ch->writes.size ()) {
+		size_t pick = 0;
+		int bank;
+		long long int row;
+		for (size_t i=0; i<ch->writes.size (); i++) {
+			int c;
+			map (d, ch->writes[i], &c, &bank, &row);
+			if (ch->banks[bank].open_row == row) {
+				pick = i;
+				break;
+			}
+		}
+		int c;
+		map (d, ch->writes[pick], &c, &bank, &row);
+		dram_do (d, channel, bank, row, now, 1);
+		ch->writes.erase (ch->writes.begin () + pick);
+	}
+}
+
+// a demand read arriving at now; returns its latency
+
+double dram_read (dram *d, unsigned long long int address, double now) {
+	int channel, bank;
+	long long int row;
+	map (d, address, &channel, &bank, &row);
+	double at = arrive (d, now);
+	double lat = dram_do (d, channel, bank, row, at + d->p.ctrl_lat, 0) - now;
+	d->reads++;
+	d->read_latency += lat;
+	return lat;
+}
+
+// a writeback arriving at now; it waits in the write queue
+
+void dram_write (dram *d, unsigned long long int address, double now) {
+	int channel, bank;
+	long long int row;
+	map (d, address, &channel, &bank, &row);
+	dram_channel *ch = &d->channels[channel];
+	double at = arrive (d, now);
+	ch->writes.push_back (address);
+	d->writes++;
+	if ((int) ch->writes.size () >= d->p.write_queue) drain (d, channel, at + d->p.ctrl_lat);
+}
+
+// counts since at_warming, which is a copy taken at the end of warm-up
+
+void dram_print_stats (dram *d, const dram *at_warming) {
+	unsigned long long int hits[2], accesses[2];
+	for (int w=0; w<2; w++) {
+		hits[w] = d->row_hits[w] - at_warming->row_hits[w];
+		accesses[w] = hits[w] + d->row_empty[w] - at_warming->row_empty[w] + d->row_conflicts[w] - at_warming->row_conflicts[w];
+	}
+	unsigned long long int reads = d->reads - at_warming->reads;
+	double busy = 0.0;
+	for (size_t i=0; i<d->channels.size (); i++)
+		busy += d->channels[i].bus_busy - (i < at_warming->channels.size () ? at_warming->channels[i].bus_busy : 0.0);
+	double elapsed = d->last_time - at_warming->last_time;
+	printf ("DRAM reads: %lld writes: %lld drains: %lld read latency: %0.1f out of order: %lld\n",
+		reads, d->writes - at_warming->writes, d->drains - at_warming->drains,
+		reads ? (d->read_latency - at_warming->read_latency) / reads : 0.0, d->late - at_warming->late);
+	printf ("DRAM row hit rate: reads %0.4f writes %0.4f all %0.4f conflicts: %lld\n",
+		accesses[0] ? hits[0] / (double) accesses[0] : 0.0,
+		accesses[1] ? hits[1] / (double) accesses[1] : 0.0,
+		accesses[0] + accesses[1] ? (hits[0] + hits[1]) / (double) (accesses[0] + accesses[1]) : 0.0,
+		d->row_conflicts[0] + d->row_conflicts[1] - at_warming->row_conflicts[0] - at_warming->row_conflicts[1]);
+	printf ("DRAM bandwidth: %0.2f bytes/cycle, data bus busy %0.4f\n",
+		elapsed > 0 ? (accesses[0] + accesses[1]) * d->p.blocksize / elapsed : 0.0,
+		elapsed > 0 ? busy / (elapsed * d->channels.size ()) : 0.0);
+}
@@ -0,0 +1,67 @@
+// a DRAM model behind the LLC, for the timing model
+//
+// memory is split into channels, each with banks that keep one row open in
+// their row buffer. a block's address picks, from the low bits up, its
+// channel, its column within a row, its bank and its row, so a stream
+// stays in one row while it spreads across channels. with the closed page
+// policy the bank comes before the column instead.
+//
+// an access costs tCAS if its row is open (a row hit), tRCD + tCAS if the
+// bank has no row open and tRP + tRCD + tCAS if another row is open (a
+// conflict), and then holds the channel's data bus for tBURST. with the
+// closed page policy every access precharges its bank when done, so there
+// are no hits and no conflicts.
+//
+// reads go to their bank as they arrive. writes wait in a per-channel
+// queue and are drained when it fills: first-ready first, i.e. writes to
+// an open row before the others, then oldest first. the drain holds the
+// banks and the bus, which is how writeback traffic slows down reads.
+//
+// all times are in core cycles, on the one clock all the cores share: the
+// timing model hands requests over in order of when they issue (see
+// timing.h), and the banks and buses are only ever compared with that
+// clock. a request stamped earlier than one already seen is taken as
+// arriving with it, so no core can book a bank in another's past.
+
+#ifndef __DRAM_H
+#define __DRAM_H
+
+#include <vector>
+
+struct dram_params {
+	int	channels, banks, row_bytes, blocksize;
+	int	closed_page;		// precharge after every access instead of keeping the row open
+	int	tCAS, tRCD, tRP, tBURST;
+	int	ctrl_lat;		// controller and interconnect, added to every read
+	int	write_queue;		// writes buffered per channel before a drain
+};
+
+struct dram_bank {
+	long long int open_row;	// -1 if precharged
+	double	busy_until;
+};
+
+struct dram_channel {
+	std::vector<dram_bank> banks;
+	std::vector<unsigned long long int> writes; // queued block addresses, oldest first
+	double	bus_free;	// cycle the data bus is next idle
+	double	bus_busy;	// cycles the data bus has been transferring
+};
+
+struct dram {
+	dram_params p;
+	std::vector<dram_channel> channels;
+	unsigned long long int reads, writes, drains;
+	unsigned long long int row_hits[2], row_empty[2], row_conflicts[2]; // [0] reads, [1] writes
+	double	read_latency;	// summed over reads
+	double	last_time;	// latest completion seen, for bandwidth
+	double	clock;		// latest arrival seen
+	unsigned long long int late; // requests stamped before clock
+};
+
+void init_dram (dram *d, const dram_params *p);
+double dram_read (dram *d, unsigned long long int address, double now);
+void dram_write (dram *d, unsigned long long int address, double now);
+void dram_print_stats (dram *d, const dram *at_warming);
+
+#endif
@@ -6,6 +6,8 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <signal.h>
+#include <time.h>
 #include <map>
 
 
@@ -15,32 +17,31 @@ using namespace std;
 #include "replacement_state.h"
 #include "cache.h"
 #include "trace.h"
+#include "fastcache.h"
+#include "timing.h"
+#include "ucp.h"
+#include "coherence.h"
+#include "prefetch.h"
+#include "telemetry.h"
+#include "pcprof.h"
 #include "model.h"
 
 #define N	1000
 
-// L1 private cache: 64KB
+// the default geometry: 64KB 4-way private L1s, 256KB 8-way private L2s and
+// a shared 4MB 16-way LLC, all with 64-byte blocks. DAN_L1_KB, DAN_L1_ASSOC,
+// DAN_L2_KB, DAN_L2_ASSOC, DAN_LLC_KB, DAN_LLC_ASSOC and DAN_BLOCKSIZE
+// change it at run time
 
 #define L1_CAPACITY	(64 * 1024)
-#define L1_BLOCKSIZE	64
 #define L1_ASSOC	4
-#define L1_NSETS	(L1_CAPACITY/(L1_BLOCKSIZE*L1_ASSOC))
-
-// L2 shared cache: 256KB
-
 #define L2_CAPACITY	(256 * 1024)
-#define L2_BLOCKSIZE	64
 #define L2_ASSOC	8
-#define L2_NSETS	(L2_CAPACITY/(L2_BLOCKSIZE*L2_ASSOC))
-
-// L3 shared cache: 4MB
-
 #ifndef LLC_CAPACITY
 #define LLC_CAPACITY	(4 * 1024 * 1024)
 #endif
-#define LLC_BLOCKSIZE	64
 #define LLC_ASSOC	16
-#define LLC_NSETS	(LLC_CAPACITY/(LLC_BLOCKSIZE*LLC_ASSOC))
+#define BLOCKSIZE	64
 
 #define MAX_CORES	16
 #define MAX_THREADS	256
@@ -52,6 +53,8 @@ trace *traces[MAX_THREADS];
 unsigned long long int 
 	l3_misses[MAX_CORES], 
 	l3_misses_at_warming[MAX_CORES],
+	memory_reads[MAX_CORES], memory_reads_at_warming[MAX_CORES], // blocks read from and written to DRAM for each core's accesses
+	memory_writes[MAX_CORES], memory_writes_at_warming[MAX_CORES],
 	l3_accesses = 0;
 int ncores, nthreads;
 bool warming = true;
@@ -71,11 +74,41 @@ unsigned long long int cycles[MAX_THREADS], cycles_at_warming[MAX_THREADS], inst
 void print_stats (void);
 double getipc (const char *);
 int dan_set_shift = 0, dan_warm_inst = 500000000, dan_policy = 0;
+int dan_warm_adaptive = 0, dan_warm_min = 10000000, dan_warm_window = 1000000, dan_warm_tol = 5;
 unsigned long long int 
 	//dan_max_inst = 1000000000, 
 	dan_max_inst = 1000000000, 
 	//dan_max_cycle = 1000000000000ull;
 	dan_max_cycle = 1;
+long long int dan_skip_inst = 0;
+int dan_trace_cache_mb = 0;
+int dan_diff = 0;
+int dan_ucp = 0, dan_ucp_interval = 1000000;
+int dan_shared = 0;
+int dan_write_aware = 0;
+int dan_l2_pf = 0, dan_llc_pf = 0, dan_pf_degree = 2, dan_pf_late = 8;
+int dan_telemetry_ms = 1000;
+int dan_profile = 0;
+const char *dan_profile_report = NULL;
+int dan_l1_kb = L1_CAPACITY / 1024, dan_l1_assoc = L1_ASSOC;
+int dan_l2_kb = L2_CAPACITY / 1024, dan_l2_assoc = L2_ASSOC;
+int dan_llc_kb = LLC_CAPACITY / 1024, dan_llc_assoc = LLC_ASSOC;
+int dan_blocksize = BLOCKSIZE;
+int dan_index = INDEX_MODULO, dan_set_hist = 0;
+
+// the timing model, when DAN_TIMING is set; defaults are roughly a 4-wide out-of-order core
+
+int dan_timing = 0;
+timing_params timing = { 4, 192, 4, 12, 40, 200, 4 };
+timing_core timing_cores[MAX_CORES], timing_at_warming[MAX_CORES];
+timing_memory timing_mem, timing_mem_at_warming;
+
+// the DRAM model behind the LLC, when DAN_DRAM is set along with DAN_TIMING;
+// DDR3-1600-like timings at a 3.2GHz core
+
+int dan_dram = 0;
+dram_params dram_config = { 2, 8, 8192, BLOCKSIZE, 0, 44, 44, 44, 16, 60, 32 };
+dram dram_state, dram_at_warming;
 char benchmark_name[1000];
 
 #define GET_PARAM(name,var) { \
@@ -88,6 +121,146 @@ char benchmark_name[1000];
                 if (!s) { if (0) fprintf (stderr, "warning: parameter %s not found in environment\n", name);} \
                 else { sscanf (s, "%lld", &var); fprintf (stderr, "%s=%lld\n", name, var); } }
 
+// number of sets in a level, which has to come out a power of 2
+
+static int geometry_nsets (const char *level, int kb, int assoc) {
+	long long int nsets = (assoc > 0) ? kb * 1024LL / ((long long int) dan_blocksize * assoc) : 0;
+	if (assoc < 1 || assoc > MAX_ASSOC || nsets < 1 || nsets * dan_blocksize * assoc != kb * 1024LL || (nsets & (nsets - 1)) || (dan_blocksize & (dan_blocksize - 1))) {
+		fprintf (stderr, "%s: %dKB %d-way with %d-byte blocks doesn't give a power-of-2 number of sets (at most %d ways)\n", level, kb, assoc, dan_blocksize, MAX_ASSOC);
+		exit (1);
+	}
+	return (int) nsets;
+}
+
+// live statistics (see telemetry.h), and a full print_stats on SIGUSR1. the
+// main loop looks at both only every TELEMETRY_CHECK records
+
+#define TELEMETRY_CHECK	0xffff
+
+telemetry_page *telemetry = NULL;
+volatile sig_atomic_t stats_requested = 0;
+
+static void request_stats (int) {
+	stats_requested = 1;
+}
+
+static double seconds (void) {
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static telemetry_page *open_telemetry (const char *path) {
+	int fd = open (path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0 || ftruncate (fd, sizeof (telemetry_page))) {
+		perror (path);
+		exit (1);
+	}
+	void *m = mmap (NULL, sizeof (telemetry_page), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (m == MAP_FAILED) {
+		perror (path);
+		exit (1);
+	}
+	close (fd);
+	telemetry_page *p = (telemetry_page *) m;
+	memset (p, 0, sizeof (*p));
+	p->magic = TELEMETRY_MAGIC;
+	p->version = TELEMETRY_VERSION;
+	return p;
+}
+
+static double model_cpi (int i, bool *have_model);
+static double start_time;
+
+static void publish_telemetry (int state, long long int iterations) {
+	static telemetry_snapshot s;
+	static double last_time;
+	static long long int last_iterations;
+	double now = seconds ();
+	s.pid = getpid ();
+	s.state = state;
+	s.ncores = ncores < TELEMETRY_CORES ? ncores : TELEMETRY_CORES;
+	snprintf (s.benchmark, sizeof (s.benchmark), "%.63s", benchmark_name);
+	s.snapshots++;
+	s.accesses = iterations;
+	s.elapsed = now - start_time;
+	if (!last_time) last_time = start_time;
+	s.accesses_per_sec = now > last_time ? (iterations - last_iterations) / (now - last_time) : 0.0;
+	last_time = now;
+	last_iterations = iterations;
+	s.llc_accesses = LLC.accesses;
+	s.llc_misses = LLC.misses;
+	for (int i=0; i<s.ncores; i++) {
+		telemetry_core *c = &s.core[i];
+		c->instructions = last_insts[i];
+		c->l1_accesses = L1[i].accesses;
+		c->l1_misses = L1[i].misses;
+		c->l2_accesses = L2[i].accesses;
+		c->l2_misses = L2[i].misses;
+		c->llc_misses = l3_misses[i];
+		unsigned long long int insts = last_insts[i] - insts_at_warming[i];
+		c->mpki = insts ? 1000.0 * (l3_misses[i] - l3_misses_at_warming[i]) / insts : 0.0;
+		if (dan_timing) {
+			double cyc = timing_cycles (&timing_cores[i]) - timing_cycles (&timing_at_warming[i]);
+			c->ipc = cyc > 0 ? insts / cyc : 0.0;
+		} else {
+			bool have_model;
+			c->ipc = insts ? 1.0 / model_cpi (i, &have_model) : 0.0;
+		}
+	}
+	telemetry_write (telemetry, &s);
+}
+
+// adaptive warm-up (DAN_WARM_ADAPTIVE): every DAN_WARM_WINDOW instructions,
+// see how full the LLC is and what the LLC MPKI of the window was. warm-up
+// ends once nearly every set has been full, or the valid blocks have
+// stopped growing for a footprint that doesn't fill it, and the MPKIs of
+// the last WARM_WINDOWS windows are within DAN_WARM_TOL percent of their
+// mean, but not before DAN_WARM_MIN instructions. DAN_WARM_INST is the most
+// it can take.
+
+#define WARM_WINDOWS	4
+#define WARM_FULL	0.99	// fraction of sets full that counts as filled
+#define WARM_FILL_STEP	0.001	// growth in valid blocks per window that counts as stopped
+
+long long int warm_next_window = 0;
+unsigned long long int warm_misses = 0, warm_insts = 0;
+double warm_mpki[WARM_WINDOWS], warm_valid = 0.0;
+int warm_windows = 0;
+const char *warm_reason = "fixed";
+long long int warm_end_inst = 0;
+
+static bool adaptive_warm_done (long long int insts) {
+	if (insts < warm_next_window) return false;
+	warm_next_window = insts + dan_warm_window;
+
+	// the window's LLC demand MPKI over all the cores
+
+	unsigned long long int misses = 0, all = 0;
+	for (int i=0; i<ncores; i++) {
+		misses += l3_misses[i];
+		all += last_insts[i];
+	}
+	warm_mpki[warm_windows++ % WARM_WINDOWS] = all > warm_insts ? 1000.0 * (misses - warm_misses) / (all - warm_insts) : 0.0;
+	warm_misses = misses;
+	warm_insts = all;
+	double full, valid;
+	fill_state (&LLC, &full, &valid);
+	bool filled = full >= WARM_FULL || valid - warm_valid < WARM_FILL_STEP;
+	warm_valid = valid;
+	if (insts < dan_warm_min || warm_windows < WARM_WINDOWS || !filled) return false;
+	double lo = warm_mpki[0], hi = warm_mpki[0], mean = 0.0;
+	for (int i=0; i<WARM_WINDOWS; i++) {
+		if (warm_mpki[i] < lo) lo = warm_mpki[i];
+		if (warm_mpki[i] > hi) hi = warm_mpki[i];
+		mean += warm_mpki[i] / WARM_WINDOWS;
+	}
+	if (hi - lo > mean * dan_warm_tol / 100.0) return false;
+	fprintf (stderr, "adaptive warm-up: LLC %0.4f of sets have been full, %0.4f of blocks valid, window MPKI %0.3f to %0.3f\n", full, valid, lo, hi);
+	warm_reason = "adaptive";
+	return true;
+}
+
 FILE *traceout = NULL;
 
 mintrace *mintraces = NULL;
@@ -109,39 +282,199 @@ int main (int argc, char *argv[]) {
 	GET_LL_PARAM ("DAN_MAX_INST", dan_max_inst);
 	GET_LL_PARAM ("DAN_MAX_CYCLE", dan_max_cycle);
 	GET_PARAM ("DAN_WARM_INST", dan_warm_inst);
+	GET_PARAM ("DAN_WARM_ADAPTIVE", dan_warm_adaptive);
+	GET_PARAM ("DAN_WARM_MIN", dan_warm_min);
+	GET_PARAM ("DAN_WARM_WINDOW", dan_warm_window);
+	GET_PARAM ("DAN_WARM_TOL", dan_warm_tol);
 	GET_PARAM ("DAN_SET_SHIFT", dan_set_shift);
+	GET_LL_PARAM ("DAN_SKIP_INST", dan_skip_inst);
+	GET_PARAM ("DAN_TRACE_CACHE_MB", dan_trace_cache_mb);
+	GET_PARAM ("DAN_L1_KB", dan_l1_kb);
+	GET_PARAM ("DAN_L1_ASSOC", dan_l1_assoc);
+	GET_PARAM ("DAN_L2_KB", dan_l2_kb);
+	GET_PARAM ("DAN_L2_ASSOC", dan_l2_assoc);
+	GET_PARAM ("DAN_LLC_KB", dan_llc_kb);
+	GET_PARAM ("DAN_LLC_ASSOC", dan_llc_assoc);
+	GET_PARAM ("DAN_BLOCKSIZE", dan_blocksize);
+	GET_PARAM ("DAN_INDEX", dan_index);
+	GET_PARAM ("DAN_SET_HIST", dan_set_hist);
+	GET_PARAM ("DAN_DIFF", dan_diff);
+	GET_PARAM ("DAN_INCLUSION", inclusion);
+	GET_PARAM ("DAN_UCP", dan_ucp);
+	GET_PARAM ("DAN_UCP_INTERVAL", dan_ucp_interval);
+	GET_PARAM ("DAN_SHARED", dan_shared);
+	GET_PARAM ("DAN_WRITE_AWARE", dan_write_aware);
+	GET_PARAM ("DAN_L2_PF", dan_l2_pf);
+	GET_PARAM ("DAN_LLC_PF", dan_llc_pf);
+	GET_PARAM ("DAN_PF_DEGREE", dan_pf_degree);
+	GET_PARAM ("DAN_PF_LATE", dan_pf_late);
+	GET_PARAM ("DAN_TELEMETRY_MS", dan_telemetry_ms);
+	GET_PARAM ("DAN_PROFILE", dan_profile);
+	GET_PARAM ("DAN_TIMING", dan_timing);
+	GET_PARAM ("DAN_WIDTH", timing.width);
+	GET_PARAM ("DAN_ROB", timing.rob);
+	GET_PARAM ("DAN_L1_LAT", timing.l1_lat);
+	GET_PARAM ("DAN_L2_LAT", timing.l2_lat);
+	GET_PARAM ("DAN_LLC_LAT", timing.llc_lat);
+	GET_PARAM ("DAN_MEM_LAT", timing.mem_lat);
+	GET_PARAM ("DAN_MEM_XFER", timing.mem_xfer);
+	GET_PARAM ("DAN_DRAM", dan_dram);
+	GET_PARAM ("DAN_DRAM_CHANNELS", dram_config.channels);
+	GET_PARAM ("DAN_DRAM_BANKS", dram_config.banks);
+	GET_PARAM ("DAN_DRAM_ROW", dram_config.row_bytes);
+	GET_PARAM ("DAN_DRAM_CLOSED", dram_config.closed_page);
+	GET_PARAM ("DAN_DRAM_TCAS", dram_config.tCAS);
+	GET_PARAM ("DAN_DRAM_TRCD", dram_config.tRCD);
+	GET_PARAM ("DAN_DRAM_TRP", dram_config.tRP);
+	GET_PARAM ("DAN_DRAM_TBURST", dram_config.tBURST);
+	GET_PARAM ("DAN_DRAM_CTRL", dram_config.ctrl_lat);
+	GET_PARAM ("DAN_DRAM_WQ", dram_config.write_queue);
 	char *s = getenv ("BENCHMARK_NAME");
 	if (s) strcpy (benchmark_name, s); else strcpy (benchmark_name, "unknown");
 
 	// initialize L1 caches
 
+	int l1_nsets = geometry_nsets ("L1", dan_l1_kb, dan_l1_assoc);
+	int l2_nsets = geometry_nsets ("L2", dan_l2_kb, dan_l2_assoc);
+	int llc_nsets = geometry_nsets ("LLC", dan_llc_kb, dan_llc_assoc);
+	dram_config.blocksize = dan_blocksize;
 	for (int i=0; i<MAX_CORES; i++) {
 		init_cache (
 			&L1[i], 	// pointer to L1 cache data structure
-			L1_NSETS, 	// number of sets in L1
-			L1_ASSOC, 	// L1 associativity
-			L1_BLOCKSIZE, 	// L1 cache block size
+			l1_nsets, 	// number of sets in L1
+			dan_l1_assoc, 	// L1 associativity
+			dan_blocksize, 	// L1 cache block size
 			dan_policy, 	// L1 replacement policy
-			0);
+			0,
+			LEVEL_L1);
 
 		// initialize L2 cache
 		init_cache (
 			&L2[i], 		// pointer to L2 cache data structure
-			L2_NSETS, 	// number of sets in L2
-			L2_ASSOC, 	// L2 cache associativity
-			L2_BLOCKSIZE, 	// L2 cache block size
+			l2_nsets, 	// number of sets in L2
+			dan_l2_assoc, 	// L2 cache associativity
+			dan_blocksize, 	// L2 cache block size
 			dan_policy, 	// L1 replacement policy
-			0);
+			0,
+			LEVEL_L2);
 	}
 
-	printf ("LLC %d bytes, %d assoc\n", LLC_NSETS * LLC_ASSOC * LLC_BLOCKSIZE, LLC_ASSOC);
+	printf ("LLC %d bytes, %d assoc\n", llc_nsets * dan_llc_assoc * dan_blocksize, dan_llc_assoc);
 	init_cache (
 		&LLC, 		// pointer to last-level cache data structure
-		LLC_NSETS, 	// number of sets in last-level cache
-		LLC_ASSOC, 	// last-level cache associativity
-		LLC_BLOCKSIZE, 	// last-level cache block size
+		llc_nsets, 	// number of sets in last-level cache
+		dan_llc_assoc, 	// last-level cache associativity
+		dan_blocksize, 	// last-level cache block size
 		dan_policy, 	// last-level cache replacement policy; 0=lru, 1=rand, etc. as in CRC
-		dan_set_shift);	// number of lower-order bits in set index to ignore; safe to set to 0 here
+		dan_set_shift,	// number of lower-order bits in set index to ignore; safe to set to 0 here
+		LEVEL_LLC);
+
+	if (dan_warm_adaptive && (dan_warm_window < 1 || dan_warm_tol < 0)) {
+		fprintf (stderr, "DAN_WARM_WINDOW must be at least 1 and DAN_WARM_TOL at least 0\n");
+		exit (1);
+	}
+
+	// how the LLC picks a set: 0 the low bits, 1 xor-folded, 2 prime modulo, 3 skewed
+
+	if (dan_index < INDEX_MODULO || dan_index > INDEX_SKEW) {
+		fprintf (stderr, "DAN_INDEX must be 0 (modulo), 1 (xor), 2 (prime modulo) or 3 (skewed)\n");
+		exit (1);
+	}
+	if (dan_index == INDEX_SKEW && (dan_ucp || (dan_policy != REPLACEMENT_POLICY_LRU && dan_policy != REPLACEMENT_POLICY_RANDOM))) {
+		fprintf (stderr, "a skewed LLC (DAN_INDEX=3) works with DAN_POLICY 0 or 1 and without DAN_UCP\n");
+		exit (1);
+	}
+	set_index_function (&LLC, dan_index);
+	if (dan_set_hist) count_set_misses (&LLC);
+
+	// split the LLC's ways among the cores by utility
+
+	if (dan_ucp) {
+		if (dan_diff) {
+			fprintf (stderr, "DAN_UCP and DAN_DIFF can't be used together; the fast engine doesn't partition\n");
+			exit (1);
+		}
+		LLC.ucp = new_ucp (&LLC, ncores, dan_ucp_interval);
+	}
+
+	// prefer clean LLC victims among the LRU-most dan_write_aware blocks
+
+	if (dan_write_aware) {
+		if (dan_policy != REPLACEMENT_POLICY_LRU || dan_index == INDEX_SKEW || dan_diff) {
+			fprintf (stderr, "DAN_WRITE_AWARE works with DAN_POLICY=0, a set-indexed LLC and without DAN_DIFF\n");
+			exit (1);
+		}
+		set_write_aware (&LLC, dan_write_aware);
+	}
+
+	// prefetchers at the L2s and the LLC: 1 next-line, 2 IP-stride, 3 stream
+
+	if (dan_l2_pf < PREFETCH_NONE || dan_l2_pf > PREFETCH_STREAM || dan_llc_pf < PREFETCH_NONE || dan_llc_pf > PREFETCH_STREAM) {
+		fprintf (stderr, "DAN_L2_PF and DAN_LLC_PF must be 0 (none), 1 (next-line), 2 (IP-stride) or 3 (stream)\n");
+		exit (1);
+	}
+	if (dan_l2_pf) for (i=0; i<MAX_CORES; i++) L2[i].pf = new_prefetcher (&L2[i], dan_l2_pf, dan_pf_degree, dan_pf_late);
+	if (dan_llc_pf) LLC.pf = new_prefetcher (&LLC, dan_llc_pf, dan_pf_degree, dan_pf_late);
+
+	// profile the top dan_profile pcs at every level, into DAN_PROFILE_REPORT or with the stats
+
+	if (dan_profile) {
+		dan_profile_report = getenv ("DAN_PROFILE_REPORT");
+		for (i=0; i<MAX_CORES; i++) {
+			L1[i].prof = new_pc_profile (&L1[i]);
+			L2[i].prof = new_pc_profile (&L2[i]);
+		}
+		LLC.prof = new_pc_profile (&LLC);
+	}
+
+	// the traces are threads of one process: keep their addresses as they
+	// are and have a directory keep the private caches coherent
+
+	if (dan_shared) {
+		if (dan_ucp) {
+			fprintf (stderr, "DAN_SHARED and DAN_UCP can't be used together; UCP finds a block's core in its address\n");
+			exit (1);
+		}
+		coherence = new_directory (MAX_CORES * (L1[0].nsets * L1[0].assoc + L2[0].nsets * L2[0].assoc));
+		for (i=0; i<MAX_CORES; i++) {
+			L1[i].dir = L2[i].dir = coherence;
+			L1[i].dir_bit = i;
+			L2[i].dir_bit = DIRECTORY_L2_BIT + i;
+		}
+	}
+
+	// check every cache access against the fast engine, stopping at the first difference
+
+	if (dan_diff) {
+		for (i=0; i<MAX_CORES; i++) {
+			enable_lockstep (&L1[i]);
+			enable_lockstep (&L2[i]);
+		}
+		enable_lockstep (&LLC);
+	}
+
+	for (i=0; i<MAX_CORES; i++) init_timing_core (&timing_cores[i]);
+	init_timing_memory (&timing_mem);
+	if (dan_dram) {
+		init_dram (&dram_state, &dram_config);
+		timing_mem.dram_model = &dram_state;
+	}
+
+	// keep each trace's first pass in memory so wrapping around doesn't decompress it again
+
+	if (dan_trace_cache_mb) for (i=0; i<nthreads; i++) readers[i]->set_replay_budget (dan_trace_cache_mb * 1048576ull);
+
+	// skip ahead in the traces; cheap for chunked traces, which have an index
+
+	if (dan_skip_inst) for (i=0; i<nthreads; i++) readers[i]->seek (dan_skip_inst);
+
+	// publish live statistics if asked to, and print them on SIGUSR1
+
+	s = getenv ("DAN_TELEMETRY");
+	if (s) telemetry = open_telemetry (s);
+	signal (SIGUSR1, request_stats);
+	start_time = seconds ();
+	double next_publish = start_time;
 
 	// prime the traces
 
@@ -162,24 +495,56 @@ int main (int argc, char *argv[]) {
 
 		// see which trace comes first in terms of cycle count (i.e. instruction count for now)
 
+		// with the timing model the cores share a memory system, so records go
+		// in order of when they issue on their cores (see timing.h)
+
 		int min_cycle_thread = -1;
+		double min_issue = 0.0;
 		for (int j=0; j<nthreads; j++) {
-			if (min_cycle_thread == -1) {
+			if (dan_timing) {
+				if (traces[j]) {
+					double issue = timing_issue_time (&timing, &timing_cores[j%MAX_CORES], traces[j]->instr);
+					if (min_cycle_thread == -1 || issue < min_issue) {
+						min_cycle_thread = j;
+						min_issue = issue;
+					}
+				}
+			} else if (min_cycle_thread == -1) {
 				if (traces[j]) min_cycle_thread = j;
 			} else {
 				if (traces[j] && (traces[j]->cycle < traces[min_cycle_thread]->cycle)) min_cycle_thread = j;
 			}
 			last_insts[j] = traces[j]->instr;// readers[j]->get_icount();
-			if (warming && last_insts[j] > dan_warm_inst) {
+			if (warming && (last_insts[j] > dan_warm_inst || (dan_warm_adaptive && adaptive_warm_done (last_insts[j])))) {
 				warming = false;
+				if (dan_warm_adaptive && last_insts[j] > dan_warm_inst) warm_reason = "maximum";
+				warm_end_inst = last_insts[j];
 				fprintf (stderr, "stopped warming at thread %d with %lld instructions...\n", j, last_insts[j]);
 				fflush (stderr);
 				for (int i=0; i<ncores; i++) {
 					l3_misses_at_warming[i] = l3_misses[i];
+					memory_reads_at_warming[i] = memory_reads[i];
+					memory_writes_at_warming[i] = memory_writes[i];
 				}
 				memcpy (cycles_at_warming, cycles, sizeof (cycles));
+				memcpy (timing_at_warming, timing_cores, sizeof (timing_cores));
+				timing_mem_at_warming = timing_mem;
+				if (dan_dram) dram_at_warming = dram_state;
+				for (int i=0; i<ncores; i++) {
+					L1[i].repl->ResetStats ();
+					L2[i].repl->ResetStats ();
+				}
+				LLC.repl->ResetStats ();
+				if (dan_profile) {
+					for (int i=0; i<ncores; i++) {
+						pc_profile_reset (L1[i].prof);
+						pc_profile_reset (L2[i].prof);
+					}
+					pc_profile_reset (LLC.prof);
+				}
 				for (int z=0; z<nthreads; z++) {
-					insts_at_warming[z] = readers[z]->get_icount();
+					// the reader's icount only moves every 100M instructions
+					insts_at_warming[z] = last_insts[z];
 				}
 			}
 		}
@@ -199,10 +564,11 @@ int main (int argc, char *argv[]) {
 		// branch then we don't need to know that.  if it is a iread
 		// or dread, or write, then we need it.
 
-		// put the core ID in the address so we have no coherence issues 
+		// put the core ID in the address so we have no coherence issues,
+		// unless the cores share an address space and the directory deals with them
 
 		t->address &= 0x00ffffffffffffffull;
-		t->address |= (((unsigned long long) min_cycle_thread % MAX_CORES) << 56);
+		if (!dan_shared) t->address |= (((unsigned long long) min_cycle_thread % MAX_CORES) << 56);
 
 		bool use_cache = true;
 		bool use_br = false;
@@ -230,7 +596,12 @@ int main (int argc, char *argv[]) {
 				t->cmd = DAN_WRITE;
 			}
 			unsigned int miss;
-			miss = memory_access (&L1[0], &L2[0], &LLC, t->address, t->pc, t->size, t->cmd, min_cycle_thread % MAX_CORES);
+			unsigned long long int memory_writebacks[MAX_MEMORY_WRITEBACKS];
+			unsigned long long int reads = traffic.memory_reads + traffic.prefetch_reads, writes = traffic.llc_to_memory;
+			miss = memory_access (&L1[0], &L2[0], &LLC, t->address, t->pc, t->size, t->cmd, min_cycle_thread % MAX_CORES, memory_writebacks);
+			memory_reads[min_cycle_thread%MAX_CORES] += traffic.memory_reads + traffic.prefetch_reads - reads;
+			memory_writes[min_cycle_thread%MAX_CORES] += traffic.llc_to_memory - writes;
+			if (dan_timing) timing_access (&timing, &timing_cores[min_cycle_thread%MAX_CORES], &timing_mem, t->instr, t->cycle, t->cmd, miss, t->address, memory_writebacks);
 			if (miss & MISS_L3_DEMAND) {
 				if ((t->cmd != DAN_WRITEBACK) && (t->cmd != DAN_PREFETCH)) {
 					l3_misses[min_cycle_thread%MAX_CORES]++;
@@ -250,6 +621,17 @@ int main (int argc, char *argv[]) {
 			print_stats ();
 		}
 		iterations++;
+		if ((iterations & TELEMETRY_CHECK) == 0) {
+			if (stats_requested) {
+				stats_requested = 0;
+				printf ("SIGUSR1: core 0 icount = %lld\n", readers[0]->get_icount());
+				print_stats ();
+			}
+			if (telemetry && seconds () >= next_publish) {
+				publish_telemetry (warming ? TELEMETRY_WARMING : TELEMETRY_MEASURING, iterations);
+				next_publish += dan_telemetry_ms / 1000.0;
+			}
+		}
 
 		// see if we are done in terms of getting to the maximum number of instructions for some thread
 
@@ -262,8 +644,8 @@ int main (int argc, char *argv[]) {
 			if (readers[j]->get_cycles() < dan_max_cycle) {
 				done_cycle = false;
 			}
-			if (readers[j]->get_icount() >= dan_max_inst) {
-				printf ("thread %d reached %lld instructions; stopping\n", j, readers[j]->get_icount());
+			if ((unsigned long long int) last_insts[j] >= dan_max_inst) {
+				printf ("thread %d reached %lld instructions; stopping\n", j, last_insts[j]);
 				done_inst = true;
 			}
 		}
@@ -273,17 +655,52 @@ int main (int argc, char *argv[]) {
 		}
 		if (done_inst) break;
 	}
+	if (dan_diff) {
+		unsigned long long int checks = LLC.lockstep->checks;
+		for (i=0; i<MAX_CORES; i++) checks += L1[i].lockstep->checks + L2[i].lockstep->checks;
+		printf ("DAN_DIFF: %lld cache accesses matched the fast engine\n", checks);
+	}
 	print_stats ();
+	if (telemetry) publish_telemetry (TELEMETRY_DONE, iterations);
 	if (traceout) fclose (traceout);
 	//for (i=0; i<ncores; i++) delete readers[i];
 	if (mintracefp) fclose (mintracefp);
 	return 0;
 }
 
+// CPI from the LLC MPKI since warm-up, by the benchmark's linear model if
+// model.h has one
+
+static double model_cpi (int i, bool *have_model) {
+	const char *name = readers[i]->getname ();
+	model *m = NULL;
+	for (int j=0; models[j].name; j++) {
+		if (strstr (name, models[j].name)) {
+			m = &models[j];
+			break;
+		}
+	}
+	*have_model = m != NULL;
+	if (!m) {
+#define L3_MISS_PENALTY	270
+		return ( L3_MISS_PENALTY * ((l3_misses[i]-l3_misses_at_warming[i]) / (double) (last_insts[i]-insts_at_warming[i])) ) + 0.33333;
+	}
+	double mpki = 1000.0 * ((l3_misses[i]-l3_misses_at_warming[i]) / (double) (last_insts[i]-insts_at_warming[i]));
+	return mpki * m->m + m->b;
+}
+
 void print_stats (void) {
 	int i;
 
 	LLC.repl->PrintStats (cout);
+#if REPL_STATS
+	for (i=0; i<ncores; i++) {
+		cout << "core " << i << " L1" << endl;
+		L1[i].repl->PrintStats (cout);
+		cout << "core " << i << " L2" << endl;
+		L2[i].repl->PrintStats (cout);
+	}
+#endif
 	// estimate number of instructions executed so far using IPC from original simulations
 
 	double sum = 0.0;
@@ -298,6 +715,7 @@ void print_stats (void) {
 	fflush (stdout);
 
 	// printf ("L3 counts: %lld %lld %lld %lld ", LLC.counts[0], LLC.counts[1], LLC.counts[2], LLC.counts[6]);
+	if (!warming) printf ("warm-up: %s, ended at %lld instructions\n", warm_reason, warm_end_inst);
 	printf ("L3 instructions: ");
 	for (i=0; i<ncores; i++) printf ("core %d: %lld ", i, last_insts[i]-insts_at_warming[i]);
 	printf ("\nL3 misses: ");
@@ -314,25 +732,106 @@ void print_stats (void) {
 			+ 0.33333;
 #else
 #endif
-		const char *name = readers[i]->getname ();
-		model *m = NULL;
-		double cpi;
-		for (int j=0; models[j].name; j++) {
-			if (strstr (name, models[j].name)) {
-				m = &models[j];
-				break;
-			}
-		}
-		if (!m) {
-			fprintf (stderr, "no model! defaulting to stupid model.\n");
-#define L3_MISS_PENALTY	270
-			cpi = ( L3_MISS_PENALTY * ((l3_misses[i]-l3_misses_at_warming[i]) / (double) (last_insts[i]-insts_at_warming[i])) ) + 0.33333;
-		} else {
-			double mpki = 1000.0 * ((l3_misses[i]-l3_misses_at_warming[i]) / (double) (last_insts[i]-insts_at_warming[i]));
-			cpi = mpki * m->m + m->b;
-		}
+		bool have_model;
+		double cpi = model_cpi (i, &have_model);
+		if (!have_model) fprintf (stderr, "no model! defaulting to stupid model.\n");
 		printf ("core %d: %0.4f IPC\n", i, 1 / cpi);
 		printf ("LLC invalidations: %lld\n", LLC.invalidations);
 	}
+
+	// the timing model's view of the same instructions
+
+	if (dan_timing && !warming) {
+		double maxcycles = 0.0;
+		for (i=0; i<ncores; i++) {
+			timing_core *tc = &timing_cores[i], *w = &timing_at_warming[i];
+			double cyc = timing_cycles (tc) - timing_cycles (w);
+			unsigned long long int mg = tc->mem_groups - w->mem_groups;
+			if (cyc > maxcycles) maxcycles = cyc;
+			printf ("core %d: %0.4f IPC timing model, %0.0f cycles, stalls L2 %0.0f LLC %0.0f memory %0.0f, MLP %0.2f\n", i,
+				cyc > 0 ? (last_insts[i] - insts_at_warming[i]) / cyc : 0.0, cyc,
+				tc->stall[1] - w->stall[1], tc->stall[2] - w->stall[2], tc->stall[3] - w->stall[3],
+				mg ? (tc->mem_grouped - w->mem_grouped) / (double) mg : 0.0);
+		}
+		// misses in flight together each wait, so the waits add up to more than the elapsed cycles
+
+		unsigned long long int xfers = timing_mem.transfers - timing_mem_at_warming.transfers;
+		unsigned long long int wbs = timing_mem.writebacks - timing_mem_at_warming.writebacks;
+		double queued = timing_mem.queue_cycles - timing_mem_at_warming.queue_cycles;
+		if (!dan_dram) printf ("memory channel: %lld transfers (%lld writebacks), %0.4f busy, %0.1f cycles queued, %0.1f per demand miss\n",
+			xfers, wbs, maxcycles > 0 ? xfers * timing.mem_xfer / maxcycles : 0.0,
+			queued, xfers > wbs ? queued / (xfers - wbs) : 0.0);
+		if (dan_dram) dram_print_stats (&dram_state, &dram_at_warming);
+	}
+
+	// prefetch-fill usefulness: useful means a demand hit before the block left this level
+
+	unsigned long long int pf[3][3];
+	memset (pf, 0, sizeof (pf));
+	for (i=0; i<ncores; i++) {
+		pf[0][0] += L1[i].pf_fills; pf[0][1] += L1[i].pf_useful; pf[0][2] += L1[i].pf_useless;
+		pf[1][0] += L2[i].pf_fills; pf[1][1] += L2[i].pf_useful; pf[1][2] += L2[i].pf_useless;
+	}
+	pf[2][0] = LLC.pf_fills; pf[2][1] = LLC.pf_useful; pf[2][2] = LLC.pf_useless;
+	for (i=0; i<3; i++) {
+		printf ("%s prefetch fills: %lld useful: %lld useless: %lld accuracy: %0.4f\n",
+			i == 0 ? "L1" : i == 1 ? "L2" : "LLC", pf[i][0], pf[i][1], pf[i][2],
+			pf[i][0] ? pf[i][1] / (double) pf[i][0] : 0.0);
+	}
+
+	// traffic between the levels, which is what the inclusion policy trades against capacity
+
+	unsigned long long int l1inv = 0, l2inv = 0;
+	for (i=0; i<ncores; i++) {
+		l1inv += L1[i].invalidations;
+		l2inv += L2[i].invalidations;
+	}
+	printf ("%s hierarchy: memory reads: %lld writebacks L1->L2: %lld L2->LLC: %lld LLC->memory: %lld\n",
+		inclusion == INCLUSION_INCLUSIVE ? "inclusive" : inclusion == INCLUSION_NINE ? "non-inclusive" : "exclusive",
+		traffic.memory_reads, traffic.l1_to_l2, traffic.l2_to_llc, traffic.llc_to_memory);
+	printf ("invalidations L1: %lld L2: %lld LLC: %lld back-invalidations: %lld removing %lld blocks, %lld dirty\n",
+		l1inv, l2inv, LLC.invalidations, traffic.back_invalidations, traffic.back_invalidated_blocks, traffic.back_invalidated_dirty);
+
+	// DRAM traffic each core's accesses caused, in blocks and bytes
+
+	unsigned long long int rsum = 0, wsum = 0;
+	printf ("memory traffic:");
+	for (i=0; i<ncores; i++) {
+		unsigned long long int r = memory_reads[i] - memory_reads_at_warming[i], w = memory_writes[i] - memory_writes_at_warming[i];
+		printf (" core %d: reads %lld writes %lld", i, r, w);
+		rsum += r;
+		wsum += w;
+	}
+	printf ("\nmemory traffic total: reads %lld (%0.1f MB) writes %lld (%0.1f MB) write fraction %0.4f\n",
+		rsum, rsum * (double) dan_blocksize / 1048576.0, wsum, wsum * (double) dan_blocksize / 1048576.0,
+		rsum + wsum ? wsum / (double) (rsum + wsum) : 0.0);
+	for (i=0; i<ncores; i++) if (L2[i].pf) {
+		char name[20];
+		sprintf (name, "core %d L2", i);
+		prefetcher_print_stats (L2[i].pf, name);
+	}
+	if (LLC.pf) prefetcher_print_stats (LLC.pf, "LLC");
+	if (LLC.write_window) printf ("LLC write-aware window %d: dirty LRU blocks spared: %lld\n", LLC.write_window, LLC.dirty_spared);
+
+	if (LLC.ucp) ucp_print_stats (LLC.ucp);
+	if (dan_profile) {
+		FILE *f = dan_profile_report ? fopen (dan_profile_report, "w") : stdout;
+		if (!f) perror (dan_profile_report);
+		else {
+			pc_profile_report (f, "L1", L1, ncores, dan_profile);
+			pc_profile_report (f, "L2", L2, ncores, dan_profile);
+			pc_profile_report (f, "LLC", &LLC, 1, dan_profile);
+			if (f != stdout) fclose (f);
+		}
+	}
+	if (coherence) directory_print_stats (coherence);
+	print_set_pressure (&LLC, "LLC");
+
+	// LLC bypass of L2 victims; a bypass is wrong if the block misses again while still remembered
+
+	printf ("LLC bypasses: %lld of %lld fills (%0.4f) dirty to memory: %lld reused: %lld accuracy: %0.4f\n",
+		LLC.bypasses, LLC.fills, LLC.fills ? LLC.bypasses / (double) LLC.fills : 0.0,
+		LLC.bypass_dirty, LLC.bypass_reused,
+		LLC.bypasses ? 1.0 - LLC.bypass_reused / (double) LLC.bypasses : 0.0);
 	fflush (stdout);
 }
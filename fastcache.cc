@@ -0,0 +1,169 @@
+// the fast cache engine and the lockstep check against cache_access (see fastcache.h)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "utils.h"
+#include "replacement_state.h"
+#include "cache.h"
+#include "fastcache.h"
+
+using namespace std;
+
+int lg2 (int n);
+
+// the same sequence cache.cc's random policy draws from, advanced in the same order
+
+static unsigned int fast_random_counter = 0;
+
+void init_fast_cache (fast_cache *f, int nsets, int assoc, int blocksize, int policy, int set_shift, int level) {
+	f->nsets = nsets;
+	f->level = level;
+	f->assoc = assoc;
+	f->policy = policy;
+	f->set_shift = set_shift;
+	f->offset_bits = lg2 (blocksize);
+	f->index_bits = lg2 (nsets);
+	f->index_mask = nsets - 1;
+	f->index_fn = INDEX_MODULO;
+	f->index_prime = nsets;
+	f->ways = new unsigned long long int[nsets * assoc];
+	memset (f->ways, 0, sizeof (unsigned long long int) * nsets * assoc);
+	f->accesses = 0;
+	f->misses = 0;
+	f->invalidations = 0;
+	f->checks = 0;
+}
+
+// same semantics as cache_access for LRU and random replacement: returns true
+// for a miss, sets *way to the way hit or filled (-1 for none) and returns the
+// victim as cache_access would, with its dirty bit. fill_dirty is whether the
+// block placed or hit arrives dirty: a dirty writeback, or a dirty block
+// moving up from the level below
+
+bool fast_access (fast_cache *f, unsigned long long int address, int op, bool do_place, bool fill_dirty, int *way, unsigned long long int *writeback_address, bool *writeback_dirty) {
+	int i, assoc = f->assoc;
+	unsigned long long int block_addr = address >> f->offset_bits;
+	unsigned int set = index_set (f, block_addr);
+	unsigned long long int tag = index_tag (f, block_addr);
+	unsigned long long int *v = &f->ways[set * assoc];
+	bool dirty = op == DAN_WRITE || fill_dirty;
+	f->accesses++;
+	*writeback_address = 0;
+	*writeback_dirty = false;
+
+	// tag match: a valid word with this tag, whatever its dirty bit
+
+	unsigned long long int key = (tag << 2) | FAST_DIRTY | FAST_VALID;
+	for (i=0; i<assoc; i++) if ((v[i] | FAST_DIRTY) == key) break;
+	if (i < assoc) {
+		*way = i;
+		unsigned long long int w = v[i] | (dirty ? FAST_DIRTY : 0);
+		if (f->policy == REPLACEMENT_POLICY_LRU && i != 0) {
+			memmove (&v[1], &v[0], i * sizeof (*v));
+			v[0] = w;
+		} else {
+			v[i] = w;
+		}
+		return false;
+	}
+	f->misses++;
+	*way = -1;
+	if (!do_place) return true;
+
+	// the first invalid way, else the policy's victim
+
+	for (i=0; i<assoc; i++) if (!(v[i] & FAST_VALID)) break;
+	if (i == assoc) i = f->policy == REPLACEMENT_POLICY_LRU ? assoc - 1 : (fast_random_counter++) % assoc;
+	*way = i;
+	if ((v[i] & FAST_VALID) && ((v[i] & FAST_DIRTY) || f->level != LEVEL_LLC)) {
+		*writeback_address = index_block (f, v[i] >> 2, set) << f->offset_bits;
+		*writeback_dirty = (v[i] & FAST_DIRTY) != 0;
+	}
+	unsigned long long int w = (tag << 2) | (dirty ? FAST_DIRTY : 0) | FAST_VALID;
+	if (f->policy == REPLACEMENT_POLICY_LRU) {
+		memmove (&v[1], &v[0], i * sizeof (*v));
+		v[0] = w;
+	} else {
+		v[i] = w;
+	}
+	return true;
+}
+
+// clear the valid way with this tag, if there is one, as invalidate does;
+// a stale tag in an invalid way is left alone
+
+bool fast_invalidate (fast_cache *f, unsigned long long int address) {
+	unsigned long long int block_addr = address >> f->offset_bits;
+	unsigned int set = index_set (f, block_addr);
+	unsigned long long int tag = index_tag (f, block_addr);
+	unsigned long long int *v = &f->ways[set * f->assoc];
+	for (int i=0; i<f->assoc; i++) {
+		if ((v[i] & FAST_VALID) && (v[i] >> 2) == tag) {
+			v[i] &= ~FAST_VALID;
+			f->invalidations++;
+			return true;
+		}
+	}
+	return false;
+}
+
+void enable_lockstep (cache *c) {
+	if (c->replacement_policy != REPLACEMENT_POLICY_LRU && c->replacement_policy != REPLACEMENT_POLICY_RANDOM) {
+		fprintf (stderr, "DAN_DIFF: no fast engine for replacement policy %d; use 0 (LRU) or 1 (random)\n", c->replacement_policy);
+		exit (1);
+	}
+	if (c->index_fn == INDEX_SKEW) {
+		fprintf (stderr, "DAN_DIFF: no fast engine for a skewed-associative cache\n");
+		exit (1);
+	}
+	assert (c->accesses == 0);
+	c->lockstep = new fast_cache;
+	init_fast_cache (c->lockstep, c->nsets, c->assoc, c->blocksize, c->replacement_policy, c->set_shift, c->level);
+	c->lockstep->index_fn = c->index_fn;
+	c->lockstep->index_prime = c->index_prime;
+}
+
+// print one set as each engine holds it, way by way
+
+static void dump_set (cache *c, unsigned int set) {
+	fast_cache *f = c->lockstep;
+	block *v = &c->sets[set].blocks[0];
+	unsigned long long int *w = &f->ways[set * f->assoc];
+	fprintf (stderr, "way  reference                    fast\n");
+	for (int i=0; i<c->assoc; i++) {
+		fprintf (stderr, "%3d  tag %12llx %c%c          tag %12llx %c%c%s\n", i,
+			v[i].tag, v[i].valid ? 'V' : '-', v[i].dirty ? 'D' : '-',
+			w[i] >> 2, (w[i] & FAST_VALID) ? 'V' : '-', (w[i] & FAST_DIRTY) ? 'D' : '-',
+			(v[i].tag != (w[i] >> 2) || !v[i].valid != !(w[i] & FAST_VALID) || (v[i].valid && !v[i].dirty != !(w[i] & FAST_DIRTY))) ? "  <--" : "");
+	}
+}
+
+static void mismatch (cache *c, const char *what, unsigned long long int address, unsigned long long int pc, int op, long long int ref, long long int fast) {
+	unsigned int set = index_set (c, address >> c->offset_bits);
+	fprintf (stderr, "DAN_DIFF: %s mismatch in the %d-way cache after %lld matching accesses\n", what, c->assoc, c->lockstep->checks);
+	fprintf (stderr, "address %llx pc %llx op %d set %u: reference %llx fast %llx\n", address, pc, op, set, ref, fast);
+	dump_set (c, set);
+	fflush (stderr);
+	exit (1);
+}
+
+void lockstep_access (cache *c, unsigned long long int address, unsigned long long int pc, int op, bool do_place, bool miss, const unsigned long long int *writeback_address, const block_meta *writeback_meta, const block_meta *fill_meta) {
+	int way;
+	unsigned long long int wb;
+	bool wb_dirty;
+	bool fast_miss = fast_access (c->lockstep, address, op, do_place, fill_meta ? fill_meta->dirty : op == DAN_WRITEBACK, &way, &wb, &wb_dirty);
+	if (miss != fast_miss) mismatch (c, "hit/miss", address, pc, op, miss, fast_miss);
+	if (way != c->last_way) mismatch (c, "way", address, pc, op, c->last_way, way);
+	if (writeback_address) {
+		if (*writeback_address != wb) mismatch (c, "writeback address", address, pc, op, *writeback_address, wb);
+		if (wb && writeback_meta && writeback_meta->dirty != wb_dirty) mismatch (c, "writeback dirty bit", address, pc, op, writeback_meta->dirty, wb_dirty);
+	}
+	c->lockstep->checks++;
+}
+
+void lockstep_invalidate (cache *c, unsigned long long int address, bool invalidated) {
+	bool fast = fast_invalidate (c->lockstep, address);
+	if (invalidated != fast) mismatch (c, "invalidate", address, 0, -1, invalidated, fast);
+}
@@ -0,0 +1,40 @@
+// a lean cache engine for LRU and random replacement, and the lockstep
+// check that runs it beside cache_access
+//
+// each set is assoc 64-bit words, tag << 2 | dirty << 1 | valid, kept in
+// the same order as the reference set's blocks (MRU first under LRU), so
+// way numbers mean the same thing in both engines. there is no per-block
+// metadata and no CRC state; a hit is a scan over one or two cache lines
+// and a move to MRU is a memmove of words instead of blocks.
+//
+// with DAN_DIFF set, exclusiu gives every cache a fast_cache shadow with
+// enable_lockstep. cache_access and invalidate then repeat each operation
+// on the shadow and compare hit/miss, the way hit or filled, and the
+// writeback address and its dirty bit; the first mismatch dumps both sets
+// and stops the run.
+
+struct fast_cache {
+	int	nsets, assoc, offset_bits, index_bits, set_shift, policy, level;
+	unsigned int index_mask;
+	int	index_fn; // as the cache's, see index_set
+	unsigned int index_prime;
+	unsigned long long int *ways; // nsets * assoc words
+	unsigned long long int accesses, misses, invalidations;
+	unsigned long long int checks; // accesses compared against the reference
+};
+
+#define FAST_VALID	1ull
+#define FAST_DIRTY	2ull
+
+void init_fast_cache (fast_cache *f, int nsets, int assoc, int blocksize, int policy, int set_shift, int level);
+bool fast_access (fast_cache *f, unsigned long long int address, int op, bool do_place, bool fill_dirty, int *way, unsigned long long int *writeback_address, bool *writeback_dirty);
+bool fast_invalidate (fast_cache *f, unsigned long long int address);
+
+// give c a shadow engine; only LRU and random caches have one
+
+void enable_lockstep (cache *c);
+
+// the lockstep hooks, called by cache_access and invalidate when c->lockstep is set
+
+void lockstep_access (cache *c, unsigned long long int address, unsigned long long int pc, int op, bool do_place, bool miss, const unsigned long long int *writeback_address, const block_meta *writeback_meta, const block_meta *fill_meta);
+void lockstep_invalidate (cache *c, unsigned long long int address, bool invalidated);
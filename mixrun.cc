@@ -0,0 +1,369 @@
+// multi-programmed mix runner
+//
+// mixrun [options] <mixfile>...
+//	-x EXE		simulator to run (default ./exclusiu)
+//	-d DIR		trace directory (default traces)
+//	-p LIST		comma separated DAN_POLICY values to run the mixes with (default 0)
+//	-b POLICY	policy for the alone runs every mix is measured against (default 0)
+//	-j N		simulations to run at once (default all CPUs)
+//	-C FILE		result cache (default mixrun.cache)
+//	-B FILE		benchmark list for -r (default benchmarks.txt)
+//	-r N		instead of running, print N random mixes ...
+//	-c N		... of N benchmarks each (default 4) ...
+//	-S SEED		... drawn with this seed (default 1)
+//
+// each line of a mix file names the benchmarks (or trace files) that share
+// the LLC, one per core; '#' starts a comment. every benchmark is also run
+// alone under the -b policy, and each mix is reported as
+//
+//	weighted speedup	sum of IPC shared / IPC alone
+//	harmonic speedup	N / sum of IPC alone / IPC shared
+//	maximum slowdown	max of IPC alone / IPC shared
+//
+// IPCs are the ones exclusiu prints, from the timing model if DAN_TIMING is
+// set. every result goes into the cache file with the policy, the simulator,
+// the DAN_* environment and the traces it came from, so a baseline is only
+// ever simulated once per configuration and an interrupted sweep picks up
+// where it stopped. the simulator and the traces are recorded with their
+// size and modification time, so rebuilding or regenerating one of them
+// makes its results stale.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include <vector>
+#include <string>
+#include <map>
+#include <algorithm>
+
+using namespace std;
+
+extern char **environ;
+
+struct job {
+	vector<string> traces;
+	int	policy;
+	string	key;
+	vector<double> ipc;	// per core, empty until it has run
+};
+
+const char *exe = "./exclusiu", *tracedir = "traces", *cachefile = "mixrun.cache", *benchfile = "benchmarks.txt";
+int baseline_policy = 0, njobs = 0, ncores = 4, nrandom = 0;
+unsigned long long int seed = 1;
+vector<int> policies;
+string envsig;		// the DAN_* settings that results depend on
+string exesig;		// the simulator, by path, size and modification time
+map<string, vector<double> > results; // key -> IPC per core
+
+// the DAN_* environment, without DAN_POLICY, as one word
+
+static string environment_signature (void) {
+	vector<string> v;
+	for (char **e=environ; *e; e++)
+		if (!strncmp (*e, "DAN_", 4) && strncmp (*e, "DAN_POLICY=", 11)) v.push_back (*e);
+	sort (v.begin (), v.end ());
+	string s;
+	for (size_t i=0; i<v.size (); i++) {
+		if (i) s += ",";
+		s += v[i];
+	}
+	return s.size () ? s : "-";
+}
+
+static bool exists (const string &name) {
+	struct stat st;
+	return stat (name.c_str (), &st) == 0;
+}
+
+// a benchmark name from benchmarks.txt, or a trace file
+
+static string trace_path (const string &name) {
+	if (name.find ('/') != string::npos || exists (name)) return name;
+	string base = string (tracedir) + "/" + name;
+	if (exists (base + ".xtr")) return base + ".xtr";
+	return base + ".gz";
+}
+
+// a file's name with its size and modification time, so a rebuilt simulator
+// or a regenerated trace doesn't pick up the old results
+
+static string file_signature (const string &name) {
+	struct stat st;
+	char buf[64];
+	if (stat (name.c_str (), &st) == 0) sprintf (buf, "@%lld.%lld", (long long int) st.st_size, (long long int) st.st_mtime);
+	else strcpy (buf, "@missing");
+	return name + buf;
+}
+
+static string job_key (int policy, const vector<string> &traces) {
+	char buf[32];
+	sprintf (buf, "%d", policy);
+	string k = string (buf) + "\t" + exesig + " " + envsig + "\t";
+	for (size_t i=0; i<traces.size (); i++) {
+		if (i) k += "+";
+		k += file_signature (traces[i]);
+	}
+	return k;
+}
+
+// cache lines are the key and then the IPCs, tab separated
+
+static void load_cache (void) {
+	FILE *f = fopen (cachefile, "r");
+	if (!f) return;
+	char line[100000];
+	while (fgets (line, sizeof (line), f)) {
+		char *p = line;
+		for (int tabs=0; *p && tabs<3; p++) if (*p == '\t') tabs++;
+		if (!*p) continue;
+		string key (line, p - line - 1);
+		vector<double> ipc;
+		char *q;
+		for (;;) {
+			double x = strtod (p, &q);
+			if (q == p) break;
+			ipc.push_back (x);
+			p = q;
+		}
+		if (ipc.size ()) results[key] = ipc;
+	}
+	fclose (f);
+}
+
+static void save_result (const job *j) {
+	FILE *f = fopen (cachefile, "a");
+	if (!f) { perror (cachefile); return; }
+	fprintf (f, "%s\t", j->key.c_str ());
+	for (size_t i=0; i<j->ipc.size (); i++) fprintf (f, "%s%0.6f", i ? " " : "", j->ipc[i]);
+	fprintf (f, "\n");
+	fclose (f);
+}
+
+// the last IPC exclusiu printed for each core
+
+static bool parse_output (const char *name, job *j) {
+	FILE *f = fopen (name, "r");
+	if (!f) return false;
+	bool timing = getenv ("DAN_TIMING") && atoi (getenv ("DAN_TIMING"));
+	j->ipc.assign (j->traces.size (), -1.0);
+	char line[10000];
+	while (fgets (line, sizeof (line), f)) {
+		int core, n = 0;
+		double ipc;
+		if (sscanf (line, "core %d: %lf IPC%n", &core, &ipc, &n) != 2 || !n) continue;
+		bool is_timing = !strncmp (line + n, " timing model", 13);
+		if (is_timing != timing || core < 0 || core >= (int) j->ipc.size ()) continue;
+		j->ipc[core] = ipc;
+	}
+	fclose (f);
+	for (size_t i=0; i<j->ipc.size (); i++) if (j->ipc[i] <= 0.0) return false;
+	return true;
+}
+
+// run every job not already in the cache, njobs at a time
+
+static void run_jobs (vector<job *> &todo) {
+	map<pid_t, pair<job *, string> > running;
+	size_t next = 0, finished = 0;
+	while (finished < todo.size ()) {
+		while (next < todo.size () && (int) running.size () < njobs) {
+			job *j = todo[next++];
+			char tmp[] = "/tmp/mixrun-XXXXXX";
+			int fd = mkstemp (tmp);
+			if (fd < 0) { perror ("mkstemp"); exit (1); }
+			fprintf (stderr, "running policy %d:", j->policy);
+			for (size_t i=0; i<j->traces.size (); i++) fprintf (stderr, " %s", j->traces[i].c_str ());
+			fprintf (stderr, "\n");
+			pid_t pid = fork ();
+			if (pid < 0) { perror ("fork"); exit (1); }
+			if (pid == 0) {
+				char pol[32];
+				sprintf (pol, "%d", j->policy);
+				setenv ("DAN_POLICY", pol, 1);
+				dup2 (fd, 1);
+				int null = open ("/dev/null", O_WRONLY);
+				if (null >= 0) dup2 (null, 2);
+				vector<char *> argv;
+				argv.push_back ((char *) exe);
+				for (size_t i=0; i<j->traces.size (); i++) argv.push_back ((char *) j->traces[i].c_str ());
+				argv.push_back (NULL);
+				execv (exe, &argv[0]);
+				_exit (127);
+			}
+			close (fd);
+			running[pid] = make_pair (j, string (tmp));
+		}
+		int status;
+		pid_t pid = wait (&status);
+		if (pid < 0) { perror ("wait"); exit (1); }
+		if (!running.count (pid)) continue;
+		job *j = running[pid].first;
+		string out = running[pid].second;
+		running.erase (pid);
+		finished++;
+		if (WIFEXITED (status) && WEXITSTATUS (status) == 0 && parse_output (out.c_str (), j)) {
+			results[j->key] = j->ipc;
+			save_result (j);
+			unlink (out.c_str ());
+		} else {
+			fprintf (stderr, "%s failed; its output is in %s\n", exe, out.c_str ());
+			j->ipc.clear ();
+		}
+	}
+}
+
+static vector<vector<string> > read_mixes (const char *name) {
+	vector<vector<string> > mixes;
+	FILE *f = strcmp (name, "-") ? fopen (name, "r") : stdin;
+	if (!f) { perror (name); exit (1); }
+	char line[10000];
+	while (fgets (line, sizeof (line), f)) {
+		char *c = strchr (line, '#');
+		if (c) *c = 0;
+		vector<string> mix;
+		for (char *w = strtok (line, " \t\r\n"); w; w = strtok (NULL, " \t\r\n")) mix.push_back (w);
+		if (mix.size ()) mixes.push_back (mix);
+	}
+	if (f != stdin) fclose (f);
+	return mixes;
+}
+
+// print n random mixes of ncores benchmarks, without repeats within a mix
+
+static void random_mixes (void) {
+	vector<vector<string> > b = read_mixes (benchfile);
+	vector<string> names;
+	for (size_t i=0; i<b.size (); i++) names.push_back (b[i][0]);
+	if ((int) names.size () < ncores) {
+		fprintf (stderr, "%s has only %d benchmarks\n", benchfile, (int) names.size ());
+		exit (1);
+	}
+	srand48 (seed);
+	for (int m=0; m<nrandom; m++) {
+		vector<string> pool = names;
+		for (int c=0; c<ncores; c++) {
+			int k = c + lrand48 () % (pool.size () - c);
+			swap (pool[c], pool[k]);
+			printf ("%s%s", c ? " " : "", pool[c].c_str ());
+		}
+		printf ("\n");
+	}
+}
+
+static job *add_job (vector<job *> &jobs, map<string, job *> &by_key, int policy, const vector<string> &traces) {
+	string key = job_key (policy, traces);
+	if (by_key.count (key)) return by_key[key];
+	job *j = new job;
+	j->traces = traces;
+	j->policy = policy;
+	j->key = key;
+	if (results.count (key)) j->ipc = results[key];
+	jobs.push_back (j);
+	by_key[key] = j;
+	return j;
+}
+
+int main (int argc, char *argv[]) {
+	int c;
+	while ((c = getopt (argc, argv, "x:d:p:b:j:C:B:r:c:S:")) != -1) {
+		switch (c) {
+		case 'x': exe = optarg; break;
+		case 'd': tracedir = optarg; break;
+		case 'p':
+			for (char *w = strtok (optarg, ","); w; w = strtok (NULL, ",")) policies.push_back (atoi (w));
+			break;
+		case 'b': baseline_policy = atoi (optarg); break;
+		case 'j': njobs = atoi (optarg); break;
+		case 'C': cachefile = optarg; break;
+		case 'B': benchfile = optarg; break;
+		case 'r': nrandom = atoi (optarg); break;
+		case 'c': ncores = atoi (optarg); break;
+		case 'S': seed = strtoull (optarg, NULL, 0); break;
+		default:
+			fprintf (stderr, "usage: %s [-x exclusiu] [-d tracedir] [-p policies] [-b baseline policy] [-j jobs] [-C cachefile] <mixfile>...\n"
+				"       %s -r N [-c cores] [-S seed] [-B benchmarks.txt]\n", argv[0], argv[0]);
+			return 1;
+		}
+	}
+	if (nrandom) {
+		random_mixes ();
+		return 0;
+	}
+	if (optind >= argc) {
+		fprintf (stderr, "%s: no mix files\n", argv[0]);
+		return 1;
+	}
+	if (!policies.size ()) policies.push_back (0);
+	if (njobs <= 0) njobs = sysconf (_SC_NPROCESSORS_ONLN);
+	if (njobs <= 0) njobs = 1;
+	envsig = environment_signature ();
+	exesig = file_signature (exe);
+	load_cache ();
+
+	// every mix under every policy, and every benchmark in them alone
+
+	vector<vector<string> > mixes;
+	for (int i=optind; i<argc; i++) {
+		vector<vector<string> > m = read_mixes (argv[i]);
+		mixes.insert (mixes.end (), m.begin (), m.end ());
+	}
+	vector<job *> jobs;
+	map<string, job *> by_key;
+	vector<vector<job *> > alone (mixes.size ()), shared (mixes.size ());
+	for (size_t m=0; m<mixes.size (); m++) {
+		vector<string> traces;
+		for (size_t i=0; i<mixes[m].size (); i++) {
+			traces.push_back (trace_path (mixes[m][i]));
+			alone[m].push_back (add_job (jobs, by_key, baseline_policy, vector<string> (1, traces.back ())));
+		}
+		for (size_t p=0; p<policies.size (); p++) shared[m].push_back (add_job (jobs, by_key, policies[p], traces));
+	}
+	vector<job *> todo;
+	for (size_t i=0; i<jobs.size (); i++) if (!jobs[i]->ipc.size ()) todo.push_back (jobs[i]);
+	fprintf (stderr, "%d simulations, %d cached, running %d at a time\n", (int) jobs.size (), (int) (jobs.size () - todo.size ()), njobs);
+	run_jobs (todo);
+
+	// the metrics
+
+	vector<double> sum_ws (policies.size (), 0.0), sum_hs (policies.size (), 0.0), sum_ms (policies.size (), 0.0);
+	vector<int> counted (policies.size (), 0);
+	printf ("%-4s %-6s %9s %9s %9s  %s\n", "mix", "policy", "weighted", "harmonic", "maxslow", "benchmarks");
+	for (size_t m=0; m<mixes.size (); m++) {
+		for (size_t p=0; p<policies.size (); p++) {
+			job *s = shared[m][p];
+			bool ok = s->ipc.size () == mixes[m].size ();
+			for (size_t i=0; i<alone[m].size (); i++) if (alone[m][i]->ipc.size () != 1) ok = false;
+			if (!ok) {
+				printf ("%-4d %-6d %9s %9s %9s  (failed)\n", (int) m, policies[p], "-", "-", "-");
+				continue;
+			}
+			double ws = 0.0, inv = 0.0, ms = 0.0;
+			for (size_t i=0; i<mixes[m].size (); i++) {
+				double slowdown = alone[m][i]->ipc[0] / s->ipc[i];
+				ws += 1.0 / slowdown;
+				inv += slowdown;
+				if (slowdown > ms) ms = slowdown;
+			}
+			double hs = mixes[m].size () / inv;
+			printf ("%-4d %-6d %9.4f %9.4f %9.4f ", (int) m, policies[p], ws, hs, ms);
+			for (size_t i=0; i<mixes[m].size (); i++) printf (" %s", mixes[m][i].c_str ());
+			printf ("\n");
+			sum_ws[p] += ws;
+			sum_hs[p] += hs;
+			sum_ms[p] += ms;
+			counted[p]++;
+		}
+	}
+	printf ("\nmeans over mixes, alone IPCs from policy %d\n", baseline_policy);
+	printf ("%-6s %9s %9s %9s %5s\n", "policy", "weighted", "harmonic", "maxslow", "mixes");
+	for (size_t p=0; p<policies.size (); p++) {
+		int n = counted[p] ? counted[p] : 1;
+		printf ("%-6d %9.4f %9.4f %9.4f %5d\n", policies[p], sum_ws[p] / n, sum_hs[p] / n, sum_ms[p] / n, counted[p]);
+	}
+	return 0;
+}
@@ -0,0 +1,135 @@
+// per-pc profile of a cache level (see pcprof.h)
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include "utils.h"
+#include "replacement_state.h"
+#include "cache.h"
+#include "pcprof.h"
+
+using namespace std;
+
+pc_profile *new_pc_profile (cache *c) {
+	pc_profile *p = new pc_profile;
+	p->sample_every = c->nsets > PCPROF_SAMPLED_SETS ? c->nsets / PCPROF_SAMPLED_SETS : 1;
+	p->depth = 4 * c->assoc;
+	if (p->depth > 256) p->depth = 256;
+	int sampled = (c->nsets + p->sample_every - 1) / p->sample_every;
+	p->stacks = new unsigned long long int[sampled * p->depth];
+	memset (p->stacks, 0, sizeof (unsigned long long int) * sampled * p->depth);
+	p->sampled_accesses = 0;
+	return p;
+}
+
+// the block's way 0 set, which is its set unless the cache is skewed
+
+bool pc_profile_sampled (pc_profile *p, cache *c, unsigned long long int address) {
+	return index_set (c, address >> c->offset_bits) % p->sample_every == 0;
+}
+
+static int bucket (int d) {
+	int b = 0;
+	while (d) {
+		d >>= 1;
+		b++;
+	}
+	return b < PCPROF_BUCKETS - 1 ? b : PCPROF_BUCKETS - 1;
+}
+
+// an access to a sampled set has been done. every access moves its block to
+// the top of the shadow stack; writebacks aren't counted, since their pc is
+// whatever caused the eviction above, and prefetches only as prefetches
+
+void pc_profile_access (pc_profile *p, cache *c, unsigned long long int address, unsigned long long int pc, int op, bool miss) {
+	unsigned long long int block_addr = address >> c->offset_bits;
+	unsigned long long int *stack = &p->stacks[(size_t) (index_set (c, block_addr) / p->sample_every) * p->depth];
+	int k;
+	for (k=0; k<p->depth; k++) if (stack[k] == block_addr + 1) break;
+	if (op == DAN_PREFETCH) p->pcs[pc].prefetches++;
+	else if (op != DAN_WRITEBACK) {
+		pc_counts *pcs = &p->pcs[pc];
+		pcs->accesses++;
+		if (miss) pcs->misses++; else pcs->hits++;
+		pcs->reuse[k < p->depth ? bucket (k) : PCPROF_BUCKETS - 1]++;
+		p->sampled_accesses++;
+	}
+	if (k == p->depth) k = p->depth - 1;
+	memmove (&stack[1], &stack[0], k * sizeof (*stack));
+	stack[0] = block_addr + 1;
+}
+
+// the access placed a block, maybe evicting one
+
+void pc_profile_fill (pc_profile *p, cache *c, unsigned long long int filling_pc) {
+	p->pcs[filling_pc].fills++;
+	if (c->evicted && !c->evicted_hits) p->pcs[c->evicted_pc].dead++;
+}
+
+// forget the counts, e.g. at the end of warm-up. the shadow stacks stay, so
+// reuse distances right after are still measured against the warm-up's accesses
+
+void pc_profile_reset (pc_profile *p) {
+	p->pcs.clear ();
+	p->sampled_accesses = 0;
+}
+
+static void add (pc_counts *to, const pc_counts *from) {
+	to->accesses += from->accesses;
+	to->hits += from->hits;
+	to->misses += from->misses;
+	to->prefetches += from->prefetches;
+	to->fills += from->fills;
+	to->dead += from->dead;
+	for (int b=0; b<PCPROF_BUCKETS; b++) to->reuse[b] += from->reuse[b];
+}
+
+static bool more_accesses (const pair<unsigned long long int, pc_counts> &a, const pair<unsigned long long int, pc_counts> &b) {
+	return a.second.accesses > b.second.accesses;
+}
+
+// the profiles of caches[0..n-1], which are one level's caches, merged
+
+void pc_profile_report (FILE *f, const char *level, cache *caches, int n, int top) {
+	map<unsigned long long int, pc_counts> all;
+	unsigned long long int sampled = 0;
+	for (int i=0; i<n; i++) {
+		pc_profile *p = caches[i].prof;
+		if (!p) continue;
+		sampled += p->sampled_accesses;
+		for (map<unsigned long long int, pc_counts>::iterator it=p->pcs.begin (); it!=p->pcs.end (); it++) {
+			map<unsigned long long int, pc_counts>::iterator a = all.find (it->first);
+			if (a == all.end ()) all[it->first] = it->second;
+			else add (&a->second, &it->second);
+		}
+	}
+	vector<pair<unsigned long long int, pc_counts> > v (all.begin (), all.end ());
+	sort (v.begin (), v.end (), more_accesses);
+	fprintf (f, "%s PC profile: %lld sampled accesses, 1 set in %d, %d PCs\n", level, sampled, caches[0].prof->sample_every, (int) v.size ());
+	fprintf (f, "%s %18s %6s %10s %8s %10s %10s %8s   reuse distance: 0 1 2-3 4-7 8-15 16-31 32-63 64-127 128-255 far\n",
+		level, "pc", "sig", "accesses", "hitrate", "prefetches", "fills", "dead");
+	for (int i=0; i<(int) v.size () && i<top; i++) {
+		pc_counts *c = &v[i].second;
+		fprintf (f, "%s %#18llx %6x %10lld %8.4f %10lld %10lld %8.4f  ", level, v[i].first, pc_signature (v[i].first),
+			c->accesses, c->accesses ? c->hits / (double) c->accesses : 0.0, c->prefetches,
+			c->fills, c->fills ? c->dead / (double) c->fills : 0.0);
+		for (int b=0; b<PCPROF_BUCKETS; b++) fprintf (f, " %0.3f", c->accesses ? c->reuse[b] / (double) c->accesses : 0.0);
+		fprintf (f, "\n");
+	}
+
+	// for each table size, the accesses by pcs that share their entry
+
+	fprintf (f, "%s signature table aliasing:", level);
+	for (int bits=8; bits<=16; bits+=2) {
+		map<unsigned int, int> users;
+		for (size_t i=0; i<v.size (); i++) users[pc_signature (v[i].first) & ((1u << bits) - 1)]++;
+		unsigned long long int shared = 0, total = 0;
+		for (size_t i=0; i<v.size (); i++) {
+			total += v[i].second.accesses;
+			if (users[pc_signature (v[i].first) & ((1u << bits) - 1)] > 1) shared += v[i].second.accesses;
+		}
+		fprintf (f, " %d entries %0.4f", 1 << bits, total ? shared / (double) total : 0.0);
+	}
+	fprintf (f, "\n");
+}
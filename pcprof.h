@@ -0,0 +1,54 @@
+// per-pc profile of a cache level (DAN_PROFILE)
+//
+// on a few sampled sets of each cache, counts for every pc:
+//
+// - demand accesses, hits and misses, charged to the pc making the access.
+//   prefetches (from the trace or the prefetchers) are counted on their own
+// - the reuse distance of its demand accesses: how many distinct blocks the set
+//   saw since the last access to the same block, from a shadow LRU stack
+//   4 times the associativity deep, in power-of-2 buckets. a block that
+//   isn't in the stack (never seen, or pushed out) counts as "far"
+// - fills, and how many of them were dead on fill, i.e. evicted without a
+//   hit, charged to the block's filling pc (the one the SHiP signature is
+//   made from), which moves with the block's metadata (see block_meta)
+//
+// counting starts over at the end of warm-up (pc_profile_reset); the shadow
+// stacks carry on. the report has the top pcs by accesses at each level
+// and, for predictor tables indexed by the pc signature modulo a power of
+// 2, the fraction of accesses made by pcs that share their table entry with
+// another pc.
+
+#ifndef __PCPROF_H
+#define __PCPROF_H
+
+#include <stdio.h>
+#include <map>
+
+#define PCPROF_SAMPLED_SETS	64
+#define PCPROF_BUCKETS		10	// 0, 1, 2-3, ..., 128-255, far
+
+struct pc_counts {
+	unsigned long long int accesses, hits, misses;
+	unsigned long long int prefetches;
+	unsigned long long int fills, dead;
+	unsigned long long int reuse[PCPROF_BUCKETS];
+};
+
+struct pc_profile {
+	int	sample_every, depth;
+	unsigned long long int *stacks;	// [sampled set * depth + position] block address + 1, 0 if empty
+	std::map<unsigned long long int, pc_counts> pcs;
+	unsigned long long int sampled_accesses;
+};
+
+struct cache;
+struct block_meta;
+
+pc_profile *new_pc_profile (cache *c);
+bool pc_profile_sampled (pc_profile *p, cache *c, unsigned long long int address);
+void pc_profile_access (pc_profile *p, cache *c, unsigned long long int address, unsigned long long int pc, int op, bool miss);
+void pc_profile_fill (pc_profile *p, cache *c, unsigned long long int filling_pc);
+void pc_profile_reset (pc_profile *p);
+void pc_profile_report (FILE *f, const char *level, cache *caches, int n, int top);
+
+#endif
@@ -0,0 +1,153 @@
+// hardware prefetchers (see prefetch.h)
+
+#include <stdio.h>
+#include <string.h>
+#include "utils.h"
+#include "replacement_state.h"
+#include "cache.h"
+#include "prefetch.h"
+
+prefetcher *new_prefetcher (cache *c, int kind, int degree, int late) {
+	prefetcher *p = new prefetcher;
+	memset (p, 0, sizeof (prefetcher));
+	p->kind = kind;
+	p->degree = degree < 1 ? 1 : degree > PREFETCH_MAX_DEGREE ? PREFETCH_MAX_DEGREE : degree;
+	p->late = late;
+	p->offset_bits = c->offset_bits;
+	unsigned int size = 1;
+	while (size < (unsigned int) (c->nsets * c->assoc)) size *= 2;
+	p->issued = new issued_entry[size];
+	memset (p->issued, 0, sizeof (issued_entry) * size);
+	p->issued_mask = size - 1;
+	return p;
+}
+
+static inline issued_entry *issued_slot (prefetcher *p, unsigned long long int block_addr) {
+	return &p->issued[((block_addr * 0x9e3779b97f4a7c15ull) >> 32) & p->issued_mask];
+}
+
+// add a candidate if it is in the same page as the trigger
+
+static inline void propose (prefetcher *p, unsigned long long int block_addr, long long int delta, unsigned long long int *out, int *n) {
+	unsigned long long int target = block_addr + delta;
+	int page_shift = PREFETCH_PAGE_BITS - p->offset_bits;
+	if (page_shift > 0 && (target >> page_shift) != (block_addr >> page_shift)) return;
+	out[(*n)++] = target << p->offset_bits;
+}
+
+static int ip_stride (prefetcher *p, unsigned long long int block_addr, unsigned long long int pc, unsigned int core, unsigned long long int *out) {
+	unsigned long long int key = pc ^ ((unsigned long long int) core << 56);
+	ip_entry *e = &p->ip[((key * 0x9e3779b97f4a7c15ull) >> 32) % PREFETCH_IP_ENTRIES];
+	int n = 0;
+	if (e->pc != key) {
+		e->pc = key;
+		e->last_block = block_addr;
+		e->stride = 0;
+		e->confidence = 0;
+		return 0;
+	}
+	long long int stride = (long long int) (block_addr - e->last_block);
+	if (!stride) return 0;
+	if (stride == e->stride) {
+		if (e->confidence < 3) e->confidence++;
+	} else if (e->confidence > 0) {
+		e->confidence--;
+	} else {
+		e->stride = stride;
+	}
+	e->last_block = block_addr;
+	if (e->confidence >= 2)
+		for (int k=1; k<=p->degree; k++) propose (p, block_addr, k * e->stride, out, &n);
+	return n;
+}
+
+static int stream (prefetcher *p, unsigned long long int block_addr, bool miss, unsigned long long int *out) {
+	int n = 0;
+	if (!miss) return 0;
+	stream_entry *s = NULL, *victim = NULL;
+	for (int i=0; i<PREFETCH_STREAMS; i++) {
+		stream_entry *t = &p->streams[i];
+		if (t->valid) {
+			long long int d = (long long int) (block_addr - t->last_block);
+			if (d != 0 && d >= -PREFETCH_STREAM_WINDOW && d <= PREFETCH_STREAM_WINDOW) {
+				s = t;
+				break;
+			}
+		}
+
+		// a new stream takes an unused tracker or the least recently used one
+
+		if (!victim || (victim->valid && (!t->valid || t->last_use < victim->last_use))) victim = t;
+	}
+	if (!s) {
+		victim->valid = true;
+		victim->last_block = block_addr;
+		victim->direction = 0;
+		victim->confidence = 0;
+		victim->last_use = p->accesses;
+		return 0;
+	}
+	int dir = block_addr > s->last_block ? 1 : -1;
+	if (dir == s->direction) {
+		if (s->confidence < 3) s->confidence++;
+	} else {
+		s->direction = dir;
+		s->confidence = 1;
+	}
+	s->last_block = block_addr;
+	s->last_use = p->accesses;
+	if (s->confidence >= 2)
+		for (int k=1; k<=p->degree; k++) propose (p, block_addr, k * dir, out, &n);
+	return n;
+}
+
+// a demand access reached the prefetcher's level; score the prefetch that
+// brought its block, if any, and put the blocks to fetch in out (room for
+// PREFETCH_MAX_DEGREE). returns how many there are.
+
+int prefetcher_train (prefetcher *p, unsigned long long int address, unsigned long long int pc, unsigned int core, bool miss, unsigned long long int *out) {
+	unsigned long long int block_addr = address >> p->offset_bits;
+	issued_entry *e = issued_slot (p, block_addr);
+	if (e->block == block_addr + 1) {
+		if (!miss) {
+			unsigned long long int d = p->accesses - e->when;
+			p->useful++;
+			p->distance += d;
+			if (d < (unsigned long long int) p->late) p->late_count++;
+		}
+		e->block = 0;
+	}
+	p->accesses++;
+	if (miss) p->misses++;
+	int n = 0;
+	switch (p->kind) {
+		case PREFETCH_NEXT_LINE: if (miss) for (int k=1; k<=p->degree; k++) propose (p, block_addr, k, out, &n); break;
+		case PREFETCH_IP_STRIDE: n = ip_stride (p, block_addr, pc, core, out); break;
+		case PREFETCH_STREAM: n = stream (p, block_addr, miss, out); break;
+	}
+	p->proposed += n;
+	return n;
+}
+
+// memory_access issued one of the proposed prefetches; the others were
+// already in the hierarchy
+
+void prefetcher_issued (prefetcher *p, unsigned long long int address, bool from_memory) {
+	unsigned long long int block_addr = address >> p->offset_bits;
+	issued_entry *e = issued_slot (p, block_addr);
+	e->block = block_addr + 1;
+	e->when = p->accesses;
+	p->issued_count++;
+	if (from_memory) p->from_memory++;
+}
+
+void prefetcher_print_stats (prefetcher *p, const char *name) {
+	static const char *kinds[] = { "none", "next-line", "IP-stride", "stream" };
+	printf ("%s %s prefetcher: issued %lld of %lld proposed, %lld from memory, useful %lld accuracy: %0.4f coverage: %0.4f\n",
+		name, kinds[p->kind], p->issued_count, p->proposed, p->from_memory, p->useful,
+		p->issued_count ? p->useful / (double) p->issued_count : 0.0,
+		p->useful + p->misses ? p->useful / (double) (p->useful + p->misses) : 0.0);
+	printf ("%s prefetch lateness: %lld late (%0.4f of useful) mean distance %0.1f accesses\n",
+		name, p->late_count, p->useful ? p->late_count / (double) p->useful : 0.0,
+		p->useful ? p->distance / (double) p->useful : 0.0);
+}
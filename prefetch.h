@@ -0,0 +1,76 @@
+// hardware prefetchers for the L2 and the LLC
+//
+// a prefetcher watches the demand accesses reaching its level (L1 misses
+// for an L2, L2 misses for the LLC) and proposes blocks to fetch ahead of
+// them, which memory_access issues as DAN_PREFETCH accesses from
+// ACCESS_PF_L2 or ACCESS_PF_LLC. it never proposes a block outside the
+// page of the access that triggered it.
+//
+//	next-line	on a miss, the next degree blocks
+//	IP-stride	per-pc last block and stride; once a pc repeats its stride
+//			twice, degree strides ahead of every access it makes
+//	stream		trackers for misses within a window of each other; once
+//			a tracker has seen two misses going the same way, degree
+//			blocks beyond the furthest one
+//
+// to judge the prefetches, each one issued is remembered (in a table the
+// size of the cache it fills) until a demand access finds it, which makes
+// it useful, or another prefetch takes its slot. accuracy is useful over
+// issued and coverage useful over useful plus the demand misses left. a
+// useful prefetch is late if its demand came within late demand accesses
+// of its issue, too soon for memory to have sent it.
+
+#ifndef __PREFETCH_H
+#define __PREFETCH_H
+
+#define PREFETCH_NONE		0
+#define PREFETCH_NEXT_LINE	1
+#define PREFETCH_IP_STRIDE	2
+#define PREFETCH_STREAM		3
+
+#define PREFETCH_MAX_DEGREE	16
+#define PREFETCH_IP_ENTRIES	256
+#define PREFETCH_STREAMS	16
+#define PREFETCH_STREAM_WINDOW	16	// blocks a miss may be from a stream to join it
+#define PREFETCH_PAGE_BITS	12
+
+struct ip_entry {
+	unsigned long long int pc, last_block;
+	long long int stride;
+	int	confidence;
+};
+
+struct stream_entry {
+	unsigned long long int last_block;	// furthest miss so far
+	int	direction, confidence;		// +1 or -1, 0 until known
+	unsigned long long int last_use;
+	bool	valid;
+};
+
+struct issued_entry {
+	unsigned long long int block;	// block address + 1, 0 if empty
+	unsigned long long int when;	// demand accesses seen before the issue
+};
+
+struct prefetcher {
+	int	kind, degree, late;
+	int	offset_bits;
+	ip_entry ip[PREFETCH_IP_ENTRIES];
+	stream_entry streams[PREFETCH_STREAMS];
+	issued_entry *issued;
+	unsigned int issued_mask;
+	unsigned long long int accesses, misses; // demand accesses it trained on, and how many missed
+	unsigned long long int proposed, issued_count; // candidates, and those not already in the hierarchy
+	unsigned long long int from_memory; // issued prefetches memory had to serve
+	unsigned long long int useful, late_count;
+	unsigned long long int distance; // demand accesses from issue to use, summed over useful prefetches
+};
+
+struct cache;
+
+prefetcher *new_prefetcher (cache *c, int kind, int degree, int late);
+int prefetcher_train (prefetcher *p, unsigned long long int address, unsigned long long int pc, unsigned int core, bool miss, unsigned long long int *out);
+void prefetcher_issued (prefetcher *p, unsigned long long int address, bool from_memory);
+void prefetcher_print_stats (prefetcher *p, const char *name);
+
+#endif
@@ -4,15 +4,24 @@
 /*    and disable the other two policy in lines 37-39                        */
 /* 2. By default, all three algorithms (SHiP2.0/ RRIP/ Set-Dueling) run on   */
 /*    L2 and use LRU for L1 and L3.                                          */
-/*    To run the algorithms on different levels, change the associvity       */
+/*    To run the algorithms on different levels, change the level checks    */
 /*    For example, if you want to implement SHiP2.0 on L3 and LRU on L1      */
 /*    and L2 change the code as below:                                       */
-/*    if (assoc == 4 || assoc == 8)                                          */
+/*    if (level == LEVEL_L1 || level == LEVEL_L2)                            */
 /*       LRU                                                                 */
 /*   else                                                                    */
 /*       SHiP                                                                */
 /* 3. To run normal SHiP on L2, change the condition in line 376             */
 /*    if (flag == 0)                                                         */
+/* 4. PREFETCH_AWARE inserts prefetched lines at low priority, does not      */
+/*    promote lines on prefetch hits and trains SHiP on a separate           */
+/*    prefetch signature table. Set it to DISABLE for the old behaviour.     */
+/* 5. SDBP_POLICY runs the sampling dead block predictor on L3 (LRU on L1    */
+/*    and L2). It evicts predicted-dead blocks first and bypasses blocks     */
+/*    predicted dead on arrival.                                             */
+/* 6. PERCEPTRON_POLICY runs the multiperspective perceptron reuse           */
+/*    predictor on L3 (LRU on L1 and L2). Its confidence picks bypass, LRU   */
+/*    insertion or MRU insertion.                                            */
 /*                                                                           */
 /*****************************************************************************/
 
@@ -29,6 +38,7 @@
 using namespace std;
 
 #include "replacement_state.h"
+#include "cache.h"
 
 #define ENABLE 1
 #define DISABLE 0
@@ -36,13 +46,282 @@ using namespace std;
 #define SHIP_2_0_POLICY             ENABLE
 #define RRIP_POLICY                 DISABLE
 #define SET_DUELING_POLICY          DISABLE
+#define SDBP_POLICY                 DISABLE
+#define PERCEPTRON_POLICY           DISABLE
+
+#define PREFETCH_AWARE              ENABLE
 
 
-/* map to store PC values based on tag+setIndex as key */
-map <unsigned long long int, unsigned long long int> pc_map;
 /* block to be evicted for RRIP algorithm */
 INT32 replace_block = 0;
 
+/*****************************************************************************/
+/* Sampling dead block predictor (Khan, Tian and Jimenez, MICRO 2010).       */
+/* A few LLC sets are shadowed by sampler sets that keep partial tags and    */
+/* the PC of the last access to each entry. A sampler eviction trains that   */
+/* PC toward dead, a sampler hit trains it toward live. Three skewed tables  */
+/* of 2-bit counters are summed to predict whether a block is dead. The      */
+/* sampler only sees accesses to sampled sets, so its cost does not grow     */
+/* with the LLC.                                                             */
+/*****************************************************************************/
+
+#define SDBP_SAMPLER_SETS       32   // number of sampler sets
+#define SDBP_SAMPLER_ASSOC      12   // sampler associativity
+#define SDBP_TAG_BITS           16   // partial tag bits kept per sampler entry
+#define SDBP_TRACE_BITS         15   // bits of the PC signature
+#define SDBP_NTABLES            3    // number of skewed prediction tables
+#define SDBP_TABLE_BITS         12   // log2 of counters per table
+#define SDBP_COUNTER_MAX        3    // 2-bit saturating counters
+#define SDBP_DEAD_THRESHOLD     8    // predict dead when the counter sum reaches this
+
+struct sampler_entry {
+    UINT32 lru_stack_position, tag, trace;
+    bool valid, prediction;
+};
+
+struct sampler {
+    UINT32 nsets, modulus;
+    sampler_entry (*sets)[SDBP_SAMPLER_ASSOC];
+    unsigned char tables[SDBP_NTABLES][1<<SDBP_TABLE_BITS];
+
+    sampler (UINT32 llc_sets) {
+        nsets = SDBP_SAMPLER_SETS;
+        if (nsets > llc_sets) nsets = llc_sets;
+        modulus = llc_sets / nsets;
+        sets = new sampler_entry[nsets][SDBP_SAMPLER_ASSOC];
+        for (UINT32 i=0; i<nsets; i++) {
+            for (UINT32 j=0; j<SDBP_SAMPLER_ASSOC; j++) {
+                sets[i][j].lru_stack_position = j;
+                sets[i][j].tag = 0;
+                sets[i][j].trace = 0;
+                sets[i][j].valid = false;
+                sets[i][j].prediction = false;
+            }
+        }
+        memset (tables, 0, sizeof (tables));
+    }
+
+    ~sampler () {
+        delete [] sets;
+    }
+
+    static UINT32 make_trace (Addr_t PC) {
+        return (PC ^ (PC >> SDBP_TRACE_BITS) ^ (PC >> (2*SDBP_TRACE_BITS))) & ((1<<SDBP_TRACE_BITS)-1);
+    }
+
+    static UINT32 make_tag (Addr_t tag) {
+        return (tag ^ (tag >> SDBP_TAG_BITS)) & ((1<<SDBP_TAG_BITS)-1);
+    }
+
+    // a different multiplicative hash per table spreads aliasing traces apart
+
+    static UINT32 index (UINT32 trace, int table) {
+        static const UINT32 mult[SDBP_NTABLES] = { 0x9e3779b1u, 0x85ebca6bu, 0xc2b2ae35u };
+        return ((trace + table) * mult[table]) >> (32 - SDBP_TABLE_BITS);
+    }
+
+    bool predict (UINT32 trace) {
+        int sum = 0;
+        for (int i=0; i<SDBP_NTABLES; i++) sum += tables[i][index (trace, i)];
+        return sum >= SDBP_DEAD_THRESHOLD;
+    }
+
+    void train (UINT32 trace, bool dead) {
+        for (int i=0; i<SDBP_NTABLES; i++) {
+            unsigned char *c = &tables[i][index (trace, i)];
+            if (dead) { if (*c < SDBP_COUNTER_MAX) (*c)++; }
+            else if (*c > 0) (*c)--;
+        }
+    }
+
+    // is this LLC set shadowed by a sampler set? if so, which one
+
+    bool sampled (UINT32 setIndex, UINT32 *s) {
+        if (setIndex % modulus) return false;
+        *s = setIndex / modulus;
+        return *s < nsets;
+    }
+
+    void promote (sampler_entry *v, UINT32 way) {
+        for (UINT32 j=0; j<SDBP_SAMPLER_ASSOC; j++)
+            if (v[j].lru_stack_position < v[way].lru_stack_position) v[j].lru_stack_position++;
+        v[way].lru_stack_position = 0;
+    }
+
+    // access sampler set s; leaving means the block moves to an upper level
+    // after this hit (exclusive hierarchy), so its entry is dropped once trained
+
+    void access (UINT32 s, Addr_t fulltag, UINT32 trace, bool leaving) {
+        sampler_entry *v = sets[s];
+        UINT32 tag = make_tag (fulltag), way;
+        for (way=0; way<SDBP_SAMPLER_ASSOC; way++)
+            if (v[way].valid && v[way].tag == tag) break;
+        if (way < SDBP_SAMPLER_ASSOC) {
+            // sampler hit: the last PC to touch this block did not leave it dead
+            train (v[way].trace, false);
+            if (leaving) {
+                v[way].valid = false;
+                return;
+            }
+        } else {
+            // a block leaving that we never sampled has nothing to teach us
+            if (leaving) return;
+
+            // sampler miss: prefer an invalid entry, then one predicted dead, then LRU
+            UINT32 victim = SDBP_SAMPLER_ASSOC;
+            for (way=0; way<SDBP_SAMPLER_ASSOC; way++) if (!v[way].valid) { victim = way; break; }
+            if (victim == SDBP_SAMPLER_ASSOC)
+                for (way=0; way<SDBP_SAMPLER_ASSOC; way++) if (v[way].prediction) { victim = way; break; }
+            if (victim == SDBP_SAMPLER_ASSOC)
+                for (way=0; way<SDBP_SAMPLER_ASSOC; way++) if (v[way].lru_stack_position == SDBP_SAMPLER_ASSOC-1) { victim = way; break; }
+            way = victim;
+            // the evicted entry's last PC was the last touch of a dead block
+            if (v[way].valid) train (v[way].trace, true);
+            v[way].valid = true;
+            v[way].tag = tag;
+        }
+        v[way].trace = trace;
+        v[way].prediction = predict (trace);
+        promote (v, way);
+    }
+};
+
+/*****************************************************************************/
+/* Multiperspective reuse prediction (Jimenez and Teran, MICRO 2017).        */
+/* Several features of an access (PC, recent PC path, filling PC, address    */
+/* bits, byte offset, access source/type and core, plus the L1/L2 reuse bits */
+/* carried with the block) each index a small table                         */
+/* of signed weights. The sum is the confidence that the block will NOT be   */
+/* reused: high enough means bypass, moderately high means LRU insertion.    */
+/* Training happens only on sampler sets, like SDBP, using the features      */
+/* remembered with each sampler entry.                                       */
+/*****************************************************************************/
+
+#define MPP_FEATURES            7    // number of features / weight tables
+#define MPP_TABLE_BITS          8    // log2 of weights per table
+#define MPP_WEIGHT_MAX          31   // 6-bit signed weights
+#define MPP_WEIGHT_MIN          -32
+#define MPP_THETA               40   // keep training until |sum| clears this
+#define MPP_TAU_BYPASS          100  // bypass at or above this confidence
+#define MPP_TAU_LRU             20   // insert at LRU at or above this confidence
+#define MPP_SAMPLER_SETS        64
+#define MPP_SAMPLER_ASSOC       16
+#define MPP_HISTORY             3    // PCs of recent accesses kept per core
+#define MPP_MAX_CORES           16
+
+struct perceptron_entry {
+    UINT32 lru_stack_position, tag;
+    bool valid;
+    INT32 yout;
+    unsigned short index[MPP_FEATURES];
+};
+
+struct perceptron {
+    UINT32 nsets, modulus;
+    perceptron_entry (*sets)[MPP_SAMPLER_ASSOC];
+    signed char weights[MPP_FEATURES][1<<MPP_TABLE_BITS];
+    Addr_t history[MPP_MAX_CORES][MPP_HISTORY];
+
+    perceptron (UINT32 llc_sets) {
+        nsets = MPP_SAMPLER_SETS;
+        if (nsets > llc_sets) nsets = llc_sets;
+        modulus = llc_sets / nsets;
+        sets = new perceptron_entry[nsets][MPP_SAMPLER_ASSOC];
+        for (UINT32 i=0; i<nsets; i++) {
+            for (UINT32 j=0; j<MPP_SAMPLER_ASSOC; j++) {
+                sets[i][j].lru_stack_position = j;
+                sets[i][j].tag = 0;
+                sets[i][j].valid = false;
+                sets[i][j].yout = 0;
+            }
+        }
+        memset (weights, 0, sizeof (weights));
+        memset (history, 0, sizeof (history));
+    }
+
+    ~perceptron () {
+        delete [] sets;
+    }
+
+    static UINT32 hash (UINT64 x, int feature) {
+        x ^= x >> 29;
+        x *= 0xbf58476d1ce4e5b9ull + 2 * feature;
+        x ^= x >> 32;
+        return (UINT32) x & ((1<<MPP_TABLE_BITS)-1);
+    }
+
+    // hash each feature of this access into its table; returns the confidence
+
+    INT32 compute (unsigned short *index, UINT32 tid, Addr_t PC, const LINE_STATE *line, UINT32 accessType, UINT32 accessSource) {
+        Addr_t *h = history[tid % MPP_MAX_CORES];
+        index[0] = hash (PC, 0);
+        index[1] = hash (PC ^ (h[0] << 1), 1);
+        index[2] = hash (h[0] ^ (h[1] << 2) ^ (h[2] << 4), 2);
+        index[3] = hash ((line->filling_pc << 2) ^ (line->reuse & 3), 3);
+        index[4] = hash (line->tag >> 4, 4);
+        index[5] = hash ((PC << 6) ^ (line->offset >> 2), 5);
+        index[6] = hash ((PC << 10) ^ accessSource ^ (accessType << 3) ^ ((tid % MPP_MAX_CORES) << 6), 6);
+        INT32 yout = 0;
+        for (int i=0; i<MPP_FEATURES; i++) yout += weights[i][index[i]];
+        return yout;
+    }
+
+    void push_history (UINT32 tid, Addr_t PC) {
+        Addr_t *h = history[tid % MPP_MAX_CORES];
+        if (h[0] == PC) return;
+        for (int i=MPP_HISTORY-1; i>0; i--) h[i] = h[i-1];
+        h[0] = PC;
+    }
+
+    // dead means the block was evicted from the sampler without reuse
+
+    void train (perceptron_entry *e, bool dead) {
+        if (dead ? e->yout >= MPP_THETA : e->yout <= -MPP_THETA) return;
+        for (int i=0; i<MPP_FEATURES; i++) {
+            signed char *w = &weights[i][e->index[i]];
+            if (dead) { if (*w < MPP_WEIGHT_MAX) (*w)++; }
+            else if (*w > MPP_WEIGHT_MIN) (*w)--;
+        }
+    }
+
+    bool sampled (UINT32 setIndex, UINT32 *s) {
+        if (setIndex % modulus) return false;
+        *s = setIndex / modulus;
+        return *s < nsets;
+    }
+
+    // access sampler set s with the features already computed for this access
+
+    void access (UINT32 s, Addr_t fulltag, const unsigned short *index, INT32 yout, bool leaving) {
+        perceptron_entry *v = sets[s];
+        UINT32 tag = (fulltag ^ (fulltag >> 16)) & 0xffff, way;
+        for (way=0; way<MPP_SAMPLER_ASSOC; way++)
+            if (v[way].valid && v[way].tag == tag) break;
+        if (way < MPP_SAMPLER_ASSOC) {
+            train (&v[way], false);
+            if (leaving) {
+                v[way].valid = false;
+                return;
+            }
+        } else {
+            if (leaving) return;
+            UINT32 victim = MPP_SAMPLER_ASSOC;
+            for (way=0; way<MPP_SAMPLER_ASSOC; way++) if (!v[way].valid) { victim = way; break; }
+            if (victim == MPP_SAMPLER_ASSOC)
+                for (way=0; way<MPP_SAMPLER_ASSOC; way++) if (v[way].lru_stack_position == MPP_SAMPLER_ASSOC-1) { victim = way; break; }
+            way = victim;
+            if (v[way].valid) train (&v[way], true);
+            v[way].valid = true;
+            v[way].tag = tag;
+        }
+        memcpy (v[way].index, index, sizeof (v[way].index));
+        v[way].yout = yout;
+        for (UINT32 j=0; j<MPP_SAMPLER_ASSOC; j++)
+            if (v[j].lru_stack_position < v[way].lru_stack_position) v[j].lru_stack_position++;
+        v[way].lru_stack_position = 0;
+    }
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 //                                                                            //
@@ -82,7 +361,23 @@ CACHE_REPLACEMENT_STATE::CACHE_REPLACEMENT_STATE( UINT32 _sets, UINT32 _assoc, U
 
     mytimer    = 0;
 
+    samp = NULL;
+    sdbp_bypasses = 0;
+    sdbp_dead_victims = 0;
+
+    perc = NULL;
+    perc_bypasses = 0;
+    perc_lru_inserts = 0;
+    perc_mru_inserts = 0;
+
+#if REPL_STATS
+    /* RRIP reports the RRPV, which goes up to 3 */
+    stat_insert_position = new COUNTER[assoc > 4 ? assoc : 4];
+    ResetStats();
+#endif
+
     InitReplacementState();
+    SetLevel (assoc == 4 ? LEVEL_L1 : assoc == 8 ? LEVEL_L2 : LEVEL_LLC);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -99,10 +394,120 @@ ostream & CACHE_REPLACEMENT_STATE::PrintStats(ostream &out)
 
     // CONTESTANTS:  Insert your statistics printing here
 
+    if (samp)
+    {
+        out<<"SDBP bypasses: "<<sdbp_bypasses<<endl;
+        out<<"SDBP dead victims: "<<sdbp_dead_victims<<endl;
+    }
+    if (perc)
+    {
+        out<<"Perceptron bypasses: "<<perc_bypasses<<endl;
+        out<<"Perceptron LRU inserts: "<<perc_lru_inserts<<endl;
+        out<<"Perceptron MRU inserts: "<<perc_mru_inserts<<endl;
+    }
+
+#if REPL_STATS
+    static const char *levels[] = { "unknown", "L1", "L2", "LLC" };
+    static const char *types[ACCESS_MAX] = { "ifetch", "load", "store", "unsupported0", "unsupported1", "prefetch", "writeback" };
+    static const char *sources[] = { "other", "L1 access", "L2 on L1 miss", "LLC on L2 miss", "L1 writeback",
+        "L2 writeback", "L2 second writeback", "L2 prefetcher", "LLC prefetcher" };
+
+    out<<"Level: "<<levels[level <= LEVEL_LLC ? level : 0]<<" sets: "<<numsets<<" ways: "<<assoc<<endl;
+    for (int t=0; t<ACCESS_MAX; t++)
+        if (stat_hits[t] || stat_misses[t])
+            out<<"Type "<<types[t]<<" hits: "<<stat_hits[t]<<" misses: "<<stat_misses[t]
+               <<" hit rate: "<<stat_hits[t] / (double) (stat_hits[t] + stat_misses[t])<<endl;
+    for (int a=0; a<REPL_STATS_SOURCES; a++)
+        if (stat_source_hits[a] || stat_source_misses[a])
+            out<<"Source "<<a<<" ("<<sources[a < 9 ? a : 0]<<") hits: "<<stat_source_hits[a]
+               <<" misses: "<<stat_source_misses[a]<<endl;
+
+    /* Where fills went; 0 is MRU (or RRPV 0) */
+    COUNTER fills = 0;
+    UINT32 positions = assoc > 4 ? assoc : 4;
+    for (UINT32 p=0; p<positions; p++)
+        fills += stat_insert_position[p];
+    out<<"Insertion positions:";
+    for (UINT32 p=0; p<positions; p++)
+        out<<" "<<p<<":"<<(fills ? stat_insert_position[p] / (double) fills : 0.0);
+    out<<endl;
+
+    if (replPolicy == CRC_REPL_CONTESTANT)
+    {
+        out<<"Bypasses: "<<stat_bypasses<<" of "<<stat_bypasses + stat_victims<<" victim selections"<<endl;
+
+        /* A distant prediction is right if the line goes without a hit, a near one if it gets one */
+        COUNTER distant = stat_distant_dead + stat_distant_hit, near = stat_near_dead + stat_near_hit;
+        out<<"Predicted distant: "<<distant<<" later hit: "<<stat_distant_hit
+           <<" accuracy: "<<(distant ? stat_distant_dead / (double) distant : 0.0)<<endl;
+        out<<"Predicted near: "<<near<<" later hit: "<<stat_near_hit
+           <<" accuracy: "<<(near ? stat_near_hit / (double) near : 0.0)<<endl;
+
+#if SHIP_2_0_POLICY
+        /* Signature counters are only trained at L2 */
+        if (level == LEVEL_L2)
+        {
+            UINT64 *tables[2] = { signature_table, prefetch_signature_table };
+            static const char *names[2] = { "demand", "prefetch" };
+            for (int t=0; t<2; t++)
+            {
+                COUNTER hist[REPL_STATS_SIGN_BUCKETS];
+                memset (hist, 0, sizeof (hist));
+                for (int i=0; i<tablesize; i++)
+                {
+                    int b = 0;
+                    for (UINT64 v=tables[t][i]; v && b<REPL_STATS_SIGN_BUCKETS-1; v>>=1)
+                        b++;
+                    hist[b]++;
+                }
+                out<<"SHiP "<<names[t]<<" signature counters: 0:"<<hist[0]<<" 1:"<<hist[1];
+                for (int b=2; b<REPL_STATS_SIGN_BUCKETS-1; b++)
+                    out<<" "<<(1<<(b-1))<<"-"<<(1<<b)-1<<":"<<hist[b];
+                out<<" "<<(1<<(REPL_STATS_SIGN_BUCKETS-2))<<"+:"<<hist[REPL_STATS_SIGN_BUCKETS-1]<<endl;
+            }
+        }
+#elif SET_DUELING_POLICY
+        if (level == LEVEL_L2)
+        {
+            out<<"PSEL every "<<stat_psel_period<<" accesses:";
+            for (UINT32 i=0; i<stat_psel_count; i++)
+                out<<" "<<stat_psel[i];
+            out<<endl;
+        }
+#endif
+    }
+#endif
+
     return out;
 
 }
 
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// Zero the statistics, e.g. at the end of warm-up. Lines filled before keep  //
+// their prediction and are counted when they are replaced.                   //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+void CACHE_REPLACEMENT_STATE::ResetStats()
+{
+#if REPL_STATS
+    memset (stat_hits, 0, sizeof (stat_hits));
+    memset (stat_misses, 0, sizeof (stat_misses));
+    memset (stat_source_hits, 0, sizeof (stat_source_hits));
+    memset (stat_source_misses, 0, sizeof (stat_source_misses));
+    memset (stat_insert_position, 0, sizeof (COUNTER) * (assoc > 4 ? assoc : 4));
+    stat_victims = 0;
+    stat_bypasses = 0;
+    stat_distant_dead = 0;
+    stat_distant_hit = 0;
+    stat_near_dead = 0;
+    stat_near_hit = 0;
+    stat_accesses = 0;
+    stat_psel_period = REPL_STATS_PSEL_PERIOD;
+    stat_psel_count = 0;
+#endif
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //                                                                            //
 // This function initializes the replacement policy hardware by creating      //
@@ -129,6 +534,11 @@ void CACHE_REPLACEMENT_STATE::InitReplacementState()
         {
             // initialize stack position (for true LRU)
             repl[ setIndex ][ way ].LRUstackposition = way;
+            repl[ setIndex ][ way ].prefetched = false;
+            repl[ setIndex ][ way ].dead = false;
+            repl[ setIndex ][ way ].filled = false;
+            repl[ setIndex ][ way ].predicted_distant = false;
+            repl[ setIndex ][ way ].reused = false;
 #if SHIP_2_0_POLICY
             /* Initialize variables for SHiP */
             repl[ setIndex ][ way ].sign=0;
@@ -147,6 +557,10 @@ void CACHE_REPLACEMENT_STATE::InitReplacementState()
     signature_table = new UINT64[tablesize];
     for(int i = 0;i < tablesize; i++)
         signature_table[i] = 0;
+    /* Prefetch fills train their own table so they don't alias demand signatures */
+    prefetch_signature_table = new UINT64[tablesize];
+    for(int i = 0;i < tablesize; i++)
+        prefetch_signature_table[i] = 0;
 
 #elif SET_DUELING_POLICY
     /* Initialize variables for set-dueling */
@@ -157,7 +571,38 @@ void CACHE_REPLACEMENT_STATE::InitReplacementState()
     for(UINT32 i = 0; i < numsets; i++)
         sd_counter[i] = 6;
 #endif
+    /* SDBP's sampler and the perceptron are made by SetLevel, only for the LLC */
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// Tell the policy which level of the hierarchy it is running in. The         //
+// constructor guesses from the associativity (4-way L1, 8-way L2, anything   //
+// else the LLC); a cache with another geometry sets it here.                 //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
 
+void CACHE_REPLACEMENT_STATE::SetLevel( UINT32 _level )
+{
+    level = _level;
+    if (replPolicy != CRC_REPL_CONTESTANT) return;
+#if SDBP_POLICY
+    if (level == LEVEL_LLC && !samp)
+        samp = new sampler (numsets);
+    if (level != LEVEL_LLC && samp)
+    {
+        delete samp;
+        samp = NULL;
+    }
+#elif PERCEPTRON_POLICY
+    if (level == LEVEL_LLC && !perc)
+        perc = new perceptron (numsets);
+    if (level != LEVEL_LLC && perc)
+    {
+        delete perc;
+        perc = NULL;
+    }
+#endif
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -167,7 +612,7 @@ void CACHE_REPLACEMENT_STATE::InitReplacementState()
 // index for the line being replaced.                                         //
 //                                                                            //
 ////////////////////////////////////////////////////////////////////////////////
-INT32 CACHE_REPLACEMENT_STATE::GetVictimInSet( UINT32 tid, UINT32 setIndex, const LINE_STATE *vicSet, UINT32 assoc, Addr_t PC, Addr_t paddr, UINT32 accessType, UINT32 accessSource ) {
+INT32 CACHE_REPLACEMENT_STATE::GetVictimInSet( UINT32 tid, UINT32 setIndex, const LINE_STATE *currLine, UINT32 assoc, Addr_t PC, Addr_t paddr, UINT32 accessType, UINT32 accessSource ) {
     // If no invalid lines, then replace based on replacement policy
     if( replPolicy == CRC_REPL_LRU )
     {
@@ -180,7 +625,14 @@ INT32 CACHE_REPLACEMENT_STATE::GetVictimInSet( UINT32 tid, UINT32 setIndex, cons
     else if( replPolicy == CRC_REPL_CONTESTANT )
     {
         // Contestants:  ADD YOUR VICTIM SELECTION FUNCTION HERE
-	return Get_My_Victim (setIndex);
+        INT32 way = Get_My_Victim (tid, setIndex, currLine, PC, accessType, accessSource);
+#if REPL_STATS
+        if (way == -1)
+            stat_bypasses++;
+        else
+            stat_victims++;
+#endif
+        return way;
     }
 
     // We should never here here
@@ -217,9 +669,102 @@ void CACHE_REPLACEMENT_STATE::UpdateReplacementState(
         // Contestants:  ADD YOUR UPDATE REPLACEMENT STATE FUNCTION HERE
         // Feel free to use any of the input parameters to make
         // updates to your replacement policy
-        UpdateMyPolicy (setIndex, updateWayID, currLine, PC, accessType, cacheHit);
+        UpdateMyPolicy (tid, setIndex, updateWayID, currLine, PC, accessType, cacheHit, accessSource);
+    }
+#if REPL_STATS
+    CountAccess (setIndex, updateWayID, accessType, cacheHit, accessSource);
+#endif
+}
+
+#if REPL_STATS
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// Statistics for one access, after the policy has updated its state. A fill  //
+// left at the LRU end (or at RRPV 3) is a prediction of distant reuse; its   //
+// outcome is known when the next fill replaces it.                           //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+void CACHE_REPLACEMENT_STATE::CountAccess( UINT32 setIndex, INT32 updateWayID, UINT32 accessType, bool cacheHit, UINT32 accessSource )
+{
+    LINE_REPLACEMENT_STATE *line = &repl[ setIndex ][ updateWayID ];
+    UINT32 source = accessSource < REPL_STATS_SOURCES ? accessSource : 0;
+
+    stat_accesses++;
+    if (cacheHit)
+    {
+        if (accessType < ACCESS_MAX) stat_hits[accessType]++;
+        stat_source_hits[source]++;
+        if (accessType != ACCESS_PREFETCH)
+            line->reused = true;
+    }
+    else
+    {
+        if (accessType < ACCESS_MAX) stat_misses[accessType]++;
+        stat_source_misses[source]++;
+        if (line->filled)
+        {
+            if (line->predicted_distant)
+                (line->reused ? stat_distant_hit : stat_distant_dead)++;
+            else
+                (line->reused ? stat_near_hit : stat_near_dead)++;
+        }
+        UINT32 position = line->LRUstackposition;
+        bool distant = position == assoc-1;
+#if RRIP_POLICY
+        if (replPolicy == CRC_REPL_CONTESTANT && level == LEVEL_L2)
+        {
+            position = line->RRPV_counter;
+            distant = position == 3;
+        }
+#endif
+        stat_insert_position[position]++;
+        line->filled = true;
+        line->predicted_distant = distant;
+        line->reused = false;
+    }
+
+#if SET_DUELING_POLICY
+    /* Sample PSEL; when the samples fill up keep every other one and sample half as often */
+    if (replPolicy == CRC_REPL_CONTESTANT && level == LEVEL_L2 && (stat_accesses & (stat_psel_period-1)) == 0)
+    {
+        if (stat_psel_count == REPL_STATS_PSEL_SAMPLES)
+        {
+            for (UINT32 i=0; i<REPL_STATS_PSEL_SAMPLES/2; i++)
+                stat_psel[i] = stat_psel[2*i+1];
+            stat_psel_count = REPL_STATS_PSEL_SAMPLES/2;
+            stat_psel_period *= 2;
+        }
+        if ((stat_accesses & (stat_psel_period-1)) == 0)
+            stat_psel[stat_psel_count++] = policy_counter;
+    }
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// Statistics for an access that doesn't reach UpdateReplacementState: a      //
+// lookup that misses without filling, a bypass, a random cache, or a         //
+// writeback the cache's own LRU handles. The policy state is left alone.     //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+void CACHE_REPLACEMENT_STATE::CountAccessOnly( UINT32 accessType, bool cacheHit, UINT32 accessSource, INT32 insertPosition )
+{
+    UINT32 source = accessSource < REPL_STATS_SOURCES ? accessSource : 0;
+
+    if (cacheHit)
+    {
+        if (accessType < ACCESS_MAX) stat_hits[accessType]++;
+        stat_source_hits[source]++;
+    }
+    else
+    {
+        if (accessType < ACCESS_MAX) stat_misses[accessType]++;
+        stat_source_misses[source]++;
+        if (insertPosition >= 0)
+            stat_insert_position[insertPosition]++;
     }
 }
+#endif
 
 ////////////////////////////////////////////////////////////////////////////////
 //                                                                            //
@@ -293,7 +838,50 @@ void CACHE_REPLACEMENT_STATE::UpdateLRU( UINT32 setIndex, INT32 updateWayID )
 	repl[ setIndex ][ updateWayID ].LRUstackposition = 0;
 }
 
-INT32 CACHE_REPLACEMENT_STATE::Get_My_Victim( UINT32 setIndex ) {
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// This function inserts a line at the bottom of the LRU stack, i.e. it will  //
+// be the next victim unless it is hit first. Lines below the current         //
+// position move up by one so the stack stays a permutation.                  //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+void CACHE_REPLACEMENT_STATE::InsertLRU( UINT32 setIndex, INT32 updateWayID )
+{
+	UINT32 currLRUstackposition = repl[ setIndex ][ updateWayID ].LRUstackposition;
+
+	for(UINT32 way=0; way<assoc; way++) {
+		if( repl[setIndex][way].LRUstackposition > currLRUstackposition ) {
+			repl[setIndex][way].LRUstackposition--;
+		}
+	}
+
+	repl[ setIndex ][ updateWayID ].LRUstackposition = assoc-1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// LRU update that knows about prefetches: a prefetch fill is inserted at     //
+// the LRU position and a prefetch hit does not promote the line. Demand      //
+// accesses behave exactly like UpdateLRU.                                    //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+void CACHE_REPLACEMENT_STATE::UpdatePrefetchAwareLRU( UINT32 setIndex, INT32 updateWayID, const LINE_STATE *currLine, UINT32 accessType, bool cacheHit )
+{
+#if PREFETCH_AWARE
+    if (cacheHit && accessType == ACCESS_PREFETCH)
+        return;
+    if (!cacheHit && currLine->prefetched)
+    {
+        InsertLRU (setIndex, updateWayID);
+        return;
+    }
+#endif
+    UpdateLRU (setIndex, updateWayID);
+}
+
+INT32 CACHE_REPLACEMENT_STATE::Get_My_Victim( UINT32 tid, UINT32 setIndex, const LINE_STATE *currLine, Addr_t PC, UINT32 accessType, UINT32 accessSource ) {
 
 #if SHIP_2_0_POLICY
     /* Using LRU to evict the victim in the set since SHiP can be used in conjunction with LRU */
@@ -301,7 +889,7 @@ INT32 CACHE_REPLACEMENT_STATE::Get_My_Victim( UINT32 setIndex ) {
 
 
 #elif RRIP_POLICY
-    if (assoc == 4 || assoc == 16)
+    if (level == LEVEL_L1 || level == LEVEL_LLC)
     {
         /* Using LRU to evict the victim for L1 and L2 */
         return Get_LRU_Victim (setIndex);
@@ -315,39 +903,92 @@ INT32 CACHE_REPLACEMENT_STATE::Get_My_Victim( UINT32 setIndex ) {
 #elif SET_DUELING_POLICY
     /* Using LRU for all levels of cache */
     return Get_LRU_Victim (setIndex);
+
+#elif SDBP_POLICY
+    if (level == LEVEL_L1 || level == LEVEL_L2)
+    {
+        /* Using LRU to evict the victim for L1 and L2 */
+        return Get_LRU_Victim (setIndex);
+    }
+
+    /* Bypass a block that is predicted dead on arrival, still training the sampler.
+       An L2 victim is traced by the PC that filled it, not the PC that evicted it */
+    UINT32 trace = sampler::make_trace (accessType == ACCESS_WRITEBACK ? currLine->filling_pc : PC), s;
+    if (samp->predict (trace))
+    {
+        if (samp->sampled (setIndex, &s))
+            samp->access (s, currLine->tag, trace, false);
+        sdbp_bypasses++;
+        return -1;
+    }
+
+    /* Otherwise evict a block predicted dead, falling back to LRU */
+    for(UINT32 way=0; way<assoc; way++)
+    {
+        if (repl[ setIndex ][ way ].dead)
+        {
+            sdbp_dead_victims++;
+            return way;
+        }
+    }
+    return Get_LRU_Victim (setIndex);
+
+#elif PERCEPTRON_POLICY
+    if (level == LEVEL_L1 || level == LEVEL_L2)
+    {
+        /* Using LRU to evict the victim for L1 and L2 */
+        return Get_LRU_Victim (setIndex);
+    }
+
+    /* Bypass when confident the block will not be reused, still training the sampler */
+    unsigned short index[MPP_FEATURES];
+    INT32 yout = perc->compute (index, tid, PC, currLine, accessType, accessSource);
+    if (yout >= MPP_TAU_BYPASS)
+    {
+        UINT32 s;
+        if (perc->sampled (setIndex, &s))
+            perc->access (s, currLine->tag, index, yout, false);
+        perc->push_history (tid, PC);
+        perc_bypasses++;
+        return -1;
+    }
+    return Get_LRU_Victim (setIndex);
 #endif
 }
 
-void CACHE_REPLACEMENT_STATE::UpdateMyPolicy(UINT32 setIndex, INT32 updateWayID, const LINE_STATE *currLine, Addr_t PC, UINT32 accessType, bool cacheHit)
+void CACHE_REPLACEMENT_STATE::UpdateMyPolicy(UINT32 tid, UINT32 setIndex, INT32 updateWayID, const LINE_STATE *currLine, Addr_t PC, UINT32 accessType, bool cacheHit, UINT32 accessSource)
 {
 
 #if SHIP_2_0_POLICY
-    /* Hashing the PC which is used as a signature */
-    UINT64 pc_initial=(PC)%(tablesize);
+    /* The signature of the PC that brought the block in, carried with the block between levels */
+    UINT64 pc_initial=(currLine->signature)%(tablesize);
 
-    if (assoc == 4)
-    {
-        /* Store the PC value with tag+setIndex as key when L1 is accessed */
-        pc_map[currLine->tag + setIndex] = pc_initial;
-    }
-    if (assoc == 4 || assoc == 16)
+    if (level == LEVEL_L1 || level == LEVEL_LLC)
     {
         /* Use LRU for L1 and L3 */
-        UpdateLRU (setIndex, updateWayID);
+        UpdatePrefetchAwareLRU (setIndex, updateWayID, currLine, accessType, cacheHit);
     }
     else
     {
         /* SHiP for L2 */
-        /* Retrive the PC for the current block */
-        map <unsigned long long int, unsigned long long int> :: iterator it = pc_map.find (currLine->tag + setIndex);
-        pc_initial = it->second;
         UINT64 pc_counter = repl[ setIndex ][ updateWayID ].sign;
+        /* Table the current line was trained in */
+        UINT64 *line_table = signature_table;
         int flag = 0;
 
+#if PREFETCH_AWARE
+        if (repl[ setIndex ][ updateWayID ].prefetched)
+            line_table = prefetch_signature_table;
+
+        /* A prefetch hit is not reuse: no training and no promotion */
+        if(cacheHit == 1 && accessType == ACCESS_PREFETCH)
+            return;
+#endif
+
         if(cacheHit == 1)
         {
             /* Cache hit, increment the signature counter */
-            signature_table[pc_counter]++;
+            line_table[pc_counter]++;
             repl[ setIndex ][ updateWayID ].outcome = 1;
         }
         else
@@ -356,15 +997,27 @@ void CACHE_REPLACEMENT_STATE::UpdateMyPolicy(UINT32 setIndex, INT32 updateWayID,
             if(repl[ setIndex ][ updateWayID ].outcome == 0)
             {
                 /* Decrement the signature counter */
-                if(signature_table[pc_counter] > 0)
+                if(line_table[pc_counter] > 0)
                 {
-                    signature_table[pc_counter]--;
+                    line_table[pc_counter]--;
                 }
             }
             /* Reset outcome */
             repl[ setIndex ][ updateWayID ].outcome = 0;
             /* Assign the new signature */
             repl[ setIndex ][ updateWayID ].sign = pc_initial;
+#if PREFETCH_AWARE
+            repl[ setIndex ][ updateWayID ].prefetched = currLine->prefetched;
+            if (currLine->prefetched)
+            {
+                /* Prefetched lines go to LRU unless their signature has proven reuse */
+                if (prefetch_signature_table[pc_initial] >= threshold)
+                    UpdateLRU (setIndex, updateWayID);
+                else
+                    InsertLRU (setIndex, updateWayID);
+                return;
+            }
+#endif
             /* If the signature counter is 0, insert the block in LRU */
             if(signature_table[pc_initial] == 0)
             {
@@ -380,20 +1033,30 @@ void CACHE_REPLACEMENT_STATE::UpdateMyPolicy(UINT32 setIndex, INT32 updateWayID,
     }
 
 #elif RRIP_POLICY
-    if (assoc == 4 || assoc == 16)
+    if (level == LEVEL_L1 || level == LEVEL_LLC)
     {
         /* Use LRU for L1 and L3 */
-        UpdateLRU (setIndex, updateWayID);
+        UpdatePrefetchAwareLRU (setIndex, updateWayID, currLine, accessType, cacheHit);
     }
     else
     {
         if (cacheHit == true)
         {
+#if PREFETCH_AWARE
+            /* A prefetch hit does not promote the line */
+            if (accessType == ACCESS_PREFETCH)
+                return;
+#endif
             /* Reset RRPV counter on cache hit */
             repl[setIndex][updateWayID].RRPV_counter = 0;
         }
         else
         {
+#if PREFETCH_AWARE
+            /* Prefetched lines are predicted distant-reuse */
+            if (currLine->prefetched)
+                repl[setIndex][updateWayID].RRPV_counter = 3;
+#endif
             /* Find the block to be evicted */
             while(1)
             {
@@ -417,10 +1080,10 @@ void CACHE_REPLACEMENT_STATE::UpdateMyPolicy(UINT32 setIndex, INT32 updateWayID,
         }
     }
 #elif SET_DUELING_POLICY
-    if (assoc == 4 || assoc == 16)
+    if (level == LEVEL_L1 || level == LEVEL_LLC)
     {
         /* Use LRU for L1 and L3 */
-        UpdateLRU (setIndex, updateWayID);
+        UpdatePrefetchAwareLRU (setIndex, updateWayID, currLine, accessType, cacheHit);
     }
     else
     {
@@ -491,6 +1154,17 @@ void CACHE_REPLACEMENT_STATE::UpdateMyPolicy(UINT32 setIndex, INT32 updateWayID,
             policy_selector = 0;
         }
 
+#if PREFETCH_AWARE
+        /* Prefetch hits don't promote, prefetch fills go to the LRU position */
+        if(cacheHit == 1 && accessType == ACCESS_PREFETCH)
+            return;
+        if(cacheHit == 0 && currLine->prefetched)
+        {
+            InsertLRU (setIndex, updateWayID);
+            return;
+        }
+#endif
+
         /* Based on previous policy_selector, do LRU or MRU */
 
         /* LRU */
@@ -507,6 +1181,56 @@ void CACHE_REPLACEMENT_STATE::UpdateMyPolicy(UINT32 setIndex, INT32 updateWayID,
         if(sd_counter[setIndex] == 0)
             sd_counter[setIndex] = 2;
     }
+#elif SDBP_POLICY
+    if (level == LEVEL_L1 || level == LEVEL_L2)
+    {
+        /* Use LRU for L1 and L2 */
+        UpdatePrefetchAwareLRU (setIndex, updateWayID, currLine, accessType, cacheHit);
+    }
+    else
+    {
+        UINT32 trace = sampler::make_trace (accessType == ACCESS_WRITEBACK ? currLine->filling_pc : PC), s;
+
+        /* An LLC hit moves the block up to L1, so it also leaves the sampler */
+        if (samp->sampled (setIndex, &s))
+            samp->access (s, currLine->tag, trace, cacheHit && accessSource == ACCESS_3);
+
+        repl[ setIndex ][ updateWayID ].dead = samp->predict (trace);
+        UpdatePrefetchAwareLRU (setIndex, updateWayID, currLine, accessType, cacheHit);
+    }
+#elif PERCEPTRON_POLICY
+    if (level == LEVEL_L1 || level == LEVEL_L2)
+    {
+        /* Use LRU for L1 and L2 */
+        UpdatePrefetchAwareLRU (setIndex, updateWayID, currLine, accessType, cacheHit);
+    }
+    else
+    {
+        unsigned short index[MPP_FEATURES];
+        INT32 yout = perc->compute (index, tid, PC, currLine, accessType, accessSource);
+        UINT32 s;
+
+        /* An LLC hit moves the block up to L1, so it also leaves the sampler */
+        if (perc->sampled (setIndex, &s))
+            perc->access (s, currLine->tag, index, yout, cacheHit && accessSource == ACCESS_3);
+        perc->push_history (tid, PC);
+
+        if (cacheHit)
+        {
+            UpdatePrefetchAwareLRU (setIndex, updateWayID, currLine, accessType, cacheHit);
+        }
+        else if (yout >= MPP_TAU_LRU || currLine->prefetched)
+        {
+            /* Likely dead: leave it where the next miss will find it */
+            InsertLRU (setIndex, updateWayID);
+            perc_lru_inserts++;
+        }
+        else
+        {
+            UpdateLRU (setIndex, updateWayID);
+            perc_mru_inserts++;
+        }
+    }
 #endif
 }
 
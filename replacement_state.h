@@ -25,6 +25,16 @@
 #define tablesize 1<<16    // Last 16 bits(PC) are used to hash the table for getting the signature
 #define max_threshold 36   // The maximum value of threshold beyond which the counter saturates
 #define threshold 6
+
+// Per-instance statistics for PrintStats. Counting is a few increments per
+// call; build with -DREPL_STATS=0 to compile it out.
+#ifndef REPL_STATS
+#define REPL_STATS 1
+#endif
+#define REPL_STATS_SOURCES      16   // accessSource values counted separately
+#define REPL_STATS_SIGN_BUCKETS 12   // signature counter histogram: 0, 1, 2-3, ..., 1024 and up
+#define REPL_STATS_PSEL_SAMPLES 64   // PSEL samples kept over the run
+#define REPL_STATS_PSEL_PERIOD  (1<<16) // accesses between PSEL samples at first
 using namespace std;
 
 // Replacement Policies Supported
@@ -47,12 +57,20 @@ typedef struct
     bool outcome;
     /* RRPV counter for RRIP */
     INT32 RRPV_counter;
+    /* line was filled by a prefetch; its signature lives in the prefetch table */
+    bool prefetched;
+    /* SDBP prediction that this line is dead */
+    bool dead;
+    /* statistics: a fill is live in this way, was inserted at the LRU end
+       (predicted distant reuse) and has had a demand hit since */
+    bool filled, predicted_distant, reused;
 
     // CONTESTANTS: Add extra state per cache line here
 
 } LINE_REPLACEMENT_STATE;
 
 struct sampler; // Jimenez's structures
+struct perceptron;
 
 // The implementation for the cache replacement policy
 class CACHE_REPLACEMENT_STATE
@@ -64,6 +82,7 @@ public:
     UINT32 numsets;
     UINT32 assoc;
     UINT32 replPolicy;
+    UINT32 level;      // 1 = L1, 2 = L2, 3 = LLC
 
     COUNTER mytimer;  // tracks # of references to the cache
 
@@ -71,7 +90,30 @@ public:
 
     /* Table to store the signature */
     UINT64 *signature_table;
-
+    /* Signature table trained only by prefetch fills, kept apart from demand */
+    UINT64 *prefetch_signature_table;
+
+    /* Sampling dead block predictor (SDBP) */
+    sampler *samp;
+    COUNTER sdbp_bypasses, sdbp_dead_victims;
+
+    /* Multiperspective perceptron reuse predictor */
+    perceptron *perc;
+    COUNTER perc_bypasses, perc_lru_inserts, perc_mru_inserts;
+
+#if REPL_STATS
+    /* Statistics, since construction or the last ResetStats */
+    COUNTER stat_hits[ACCESS_MAX], stat_misses[ACCESS_MAX];
+    COUNTER stat_source_hits[REPL_STATS_SOURCES], stat_source_misses[REPL_STATS_SOURCES];
+    COUNTER *stat_insert_position;      // fills by stack position (RRPV for RRIP)
+    COUNTER stat_victims, stat_bypasses;
+    /* outcome of each fill, counted when the next fill replaces it */
+    COUNTER stat_distant_dead, stat_distant_hit, stat_near_dead, stat_near_hit;
+    /* set-dueling selector sampled over time; the period doubles when full */
+    COUNTER stat_accesses, stat_psel_period;
+    INT32 stat_psel[REPL_STATS_PSEL_SAMPLES];
+    UINT32 stat_psel_count;
+#endif
 
   public:
     /* Policy counter which increments on LRU and decrements on MRU */
@@ -83,20 +125,29 @@ public:
 
   public:
     ostream & PrintStats(ostream &out);
+    void   ResetStats();
 
     // The constructor CAN NOT be changed
     CACHE_REPLACEMENT_STATE( UINT32 _sets, UINT32 _assoc, UINT32 _pol );
 
-    INT32 GetVictimInSet( UINT32 tid, UINT32 setIndex, const LINE_STATE *vicSet, UINT32 assoc, Addr_t PC, Addr_t paddr, UINT32 accessType, UINT32 accessSource);
+    INT32 GetVictimInSet( UINT32 tid, UINT32 setIndex, const LINE_STATE *currLine, UINT32 assoc, Addr_t PC, Addr_t paddr, UINT32 accessType, UINT32 accessSource);
 
     void   UpdateReplacementState( UINT32 setIndex, INT32 updateWayID);
 
     void   SetReplacementPolicy( UINT32 _pol ) { replPolicy = _pol; }
+    void   SetLevel( UINT32 _level );
     void   IncrementTimer() { mytimer++; }
 
     void   UpdateReplacementState( UINT32 setIndex, INT32 updateWayID, const LINE_STATE *currLine,
                                    UINT32 tid, Addr_t PC, UINT32 accessType, bool cacheHit, UINT32 accessSource);
 
+    /* Statistics for an access the policy isn't told about; insertPosition is -1 if nothing was filled */
+#if REPL_STATS
+    void   CountAccessOnly( UINT32 accessType, bool cacheHit, UINT32 accessSource, INT32 insertPosition );
+#else
+    void   CountAccessOnly( UINT32, bool, UINT32, INT32 ) { }
+#endif
+
     ~CACHE_REPLACEMENT_STATE(void);
 
   private:
@@ -105,9 +156,14 @@ public:
     INT32  Get_Random_Victim( UINT32 setIndex );
 
     INT32  Get_LRU_Victim( UINT32 setIndex );
-    INT32  Get_My_Victim( UINT32 setIndex );
+    INT32  Get_My_Victim( UINT32 tid, UINT32 setIndex, const LINE_STATE *currLine, Addr_t PC, UINT32 accessType, UINT32 accessSource );
     void   UpdateLRU( UINT32 setIndex, INT32 updateWayID );
-    void   UpdateMyPolicy( UINT32 setIndex, INT32 updateWayID, const LINE_STATE *currLine, Addr_t PC, UINT32 accessType, bool cacheHit );
+    void   InsertLRU( UINT32 setIndex, INT32 updateWayID );
+    void   UpdatePrefetchAwareLRU( UINT32 setIndex, INT32 updateWayID, const LINE_STATE *currLine, UINT32 accessType, bool cacheHit );
+    void   UpdateMyPolicy( UINT32 tid, UINT32 setIndex, INT32 updateWayID, const LINE_STATE *currLine, Addr_t PC, UINT32 accessType, bool cacheHit, UINT32 accessSource );
+#if REPL_STATS
+    void   CountAccess( UINT32 setIndex, INT32 updateWayID, UINT32 accessType, bool cacheHit, UINT32 accessSource );
+#endif
 };
 
 #endif
@@ -0,0 +1,92 @@
+// show the live statistics of a running exclusiu (see telemetry.h)
+//
+// statsview [-i seconds] [-1] <file>
+//	-i SECONDS	time between displays (default 1)
+//	-1		show one snapshot and exit
+//
+// the file is the one DAN_TELEMETRY named. statsview keeps going until the
+// run finishes or its process is gone.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include "telemetry.h"
+
+static const char *states[] = { "warming", "measuring", "done" };
+
+static double rate (unsigned long long int part, unsigned long long int whole) {
+	return whole ? part / (double) whole : 0.0;
+}
+
+static void show (const telemetry_snapshot *s) {
+	bool alive = kill (s->pid, 0) == 0 || errno == EPERM;
+	printf ("%s pid %d %s%s: %0.0f s, %lld records, %0.2fM records/s, snapshot %lld\n",
+		s->benchmark, s->pid, states[s->state], s->state != TELEMETRY_DONE && !alive ? " (exited)" : "",
+		s->elapsed, s->accesses, s->accesses_per_sec / 1e6, s->snapshots);
+	printf ("LLC accesses %lld misses %lld miss rate %0.4f\n", s->llc_accesses, s->llc_misses, rate (s->llc_misses, s->llc_accesses));
+	printf ("core %14s %10s %10s %12s %9s %7s\n", "instructions", "L1 miss", "L2 miss", "LLC misses", "MPKI", "IPC");
+	for (int i=0; i<s->ncores; i++) {
+		const telemetry_core *c = &s->core[i];
+		printf ("%4d %14lld %10.4f %10.4f %12lld %9.4f %7.4f\n", i, c->instructions,
+			rate (c->l1_misses, c->l1_accesses), rate (c->l2_misses, c->l2_accesses), c->llc_misses, c->mpki, c->ipc);
+	}
+	fflush (stdout);
+}
+
+int main (int argc, char *argv[]) {
+	double interval = 1.0;
+	bool once = false;
+	int c;
+	while ((c = getopt (argc, argv, "i:1")) != -1) {
+		switch (c) {
+			case 'i': interval = atof (optarg); break;
+			case '1': once = true; break;
+			default:
+			fprintf (stderr, "usage: %s [-i seconds] [-1] <file>\n", argv[0]);
+			return 1;
+		}
+	}
+	if (optind >= argc) {
+		fprintf (stderr, "%s: need the DAN_TELEMETRY file\n", argv[0]);
+		return 1;
+	}
+	const char *name = argv[optind];
+	int fd = open (name, O_RDONLY);
+	if (fd < 0) {
+		perror (name);
+		return 1;
+	}
+	void *m = mmap (NULL, sizeof (telemetry_page), PROT_READ, MAP_SHARED, fd, 0);
+	if (m == MAP_FAILED) {
+		perror (name);
+		return 1;
+	}
+	close (fd);
+	const telemetry_page *p = (const telemetry_page *) m;
+	if (p->magic != TELEMETRY_MAGIC || p->version != TELEMETRY_VERSION) {
+		fprintf (stderr, "%s: not a version %d telemetry file\n", name, TELEMETRY_VERSION);
+		return 1;
+	}
+	unsigned long long int shown = 0;
+	for (;;) {
+		telemetry_snapshot s;
+
+		// the simulator only holds the page for a memcpy, so a few tries do
+
+		bool ok = false;
+		for (int tries=0; tries<1000 && !(ok = telemetry_read (p, &s)); tries++) usleep (100);
+		if (ok && s.snapshots && s.snapshots != shown) {
+			if (shown) printf ("\n");
+			show (&s);
+			shown = s.snapshots;
+		}
+		if (once && shown) break;
+		if (ok && s.snapshots && (s.state == TELEMETRY_DONE || (kill (s.pid, 0) && errno != EPERM))) break;
+		usleep ((useconds_t) (interval * 1e6));
+	}
+	return 0;
+}
@@ -0,0 +1,70 @@
+// live statistics from a running simulation (DAN_TELEMETRY)
+//
+// exclusiu maps the file DAN_TELEMETRY names and every DAN_TELEMETRY_MS
+// milliseconds copies its counters into it as a snapshot. statsview, or
+// anything else that maps the same file, can read the snapshots while the
+// run goes on. the page is a seqlock: the simulator makes seq odd, writes
+// the snapshot and makes seq even again; a reader copies the snapshot out
+// and keeps it only if seq was the same even number before and after. the
+// simulator never waits for a reader, and the per-access path doesn't
+// touch the page at all.
+
+#ifndef __TELEMETRY_H
+#define __TELEMETRY_H
+
+#include <string.h>
+
+#define TELEMETRY_MAGIC		0x6d6c6574	// "telm"
+#define TELEMETRY_VERSION	1
+#define TELEMETRY_CORES		16
+
+#define TELEMETRY_WARMING	0
+#define TELEMETRY_MEASURING	1
+#define TELEMETRY_DONE		2
+
+// counters are since the start of the run, except mpki and ipc, which are
+// since the end of warm-up once it has ended
+
+struct telemetry_core {
+	unsigned long long int instructions;
+	unsigned long long int l1_accesses, l1_misses, l2_accesses, l2_misses;
+	unsigned long long int llc_misses;	// demand misses, as in "L3 misses"
+	double	mpki, ipc;			// ipc from the timing model if it is on, model.h otherwise
+};
+
+struct telemetry_snapshot {
+	int	pid, state, ncores;
+	char	benchmark[64];
+	unsigned long long int snapshots;	// taken so far, including this one
+	unsigned long long int accesses;	// trace records simulated
+	double	elapsed;			// seconds since the simulation started
+	double	accesses_per_sec;		// over the last interval
+	unsigned long long int llc_accesses, llc_misses;
+	telemetry_core core[TELEMETRY_CORES];
+};
+
+struct telemetry_page {
+	unsigned int magic, version;
+	unsigned int seq;			// odd while a snapshot is being written
+	telemetry_snapshot s;
+};
+
+static inline void telemetry_write (telemetry_page *p, const telemetry_snapshot *s) {
+	unsigned int seq = p->seq;
+	__atomic_store_n (&p->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence (__ATOMIC_RELEASE);
+	memcpy (&p->s, s, sizeof (*s));
+	__atomic_store_n (&p->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+// returns false if the simulator was writing; try again
+
+static inline bool telemetry_read (const telemetry_page *p, telemetry_snapshot *s) {
+	unsigned int before = __atomic_load_n (&p->seq, __ATOMIC_ACQUIRE);
+	if (before & 1) return false;
+	memcpy (s, (const void *) &p->s, sizeof (*s));
+	__atomic_thread_fence (__ATOMIC_ACQUIRE);
+	return __atomic_load_n (&p->seq, __ATOMIC_RELAXED) == before;
+}
+
+#endif
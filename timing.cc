@@ -0,0 +1,127 @@
+// the timing model (see timing.h)
+
+#include <stdio.h>
+#include <string.h>
+#include "utils.h"
+#include "replacement_state.h"
+#include "cache.h"
+#include "timing.h"
+
+void init_timing_core (timing_core *tc) {
+	memset (tc, 0, sizeof (*tc));
+}
+
+void init_timing_memory (timing_memory *mem) {
+	memset (mem, 0, sizeof (*mem));
+}
+
+// stall until the current group's last access completes
+
+static void close_group (timing_core *tc) {
+	if (!tc->group_open) return;
+	if (tc->group_end > tc->now) {
+		tc->stall[tc->group_level] += tc->group_end - tc->now;
+		tc->now = tc->group_end;
+	}
+	if (tc->group_mem) {
+		tc->mem_groups++;
+		tc->mem_grouped += tc->group_mem;
+	}
+	tc->group_mem = 0;
+	tc->group_open = false;
+}
+
+// occupy the memory channel with one block, returning how long it waited
+
+static double memory_transfer (const timing_params *p, timing_memory *mem, double now) {
+	double start = mem->free_at > now ? mem->free_at : now;
+	mem->free_at = start + p->mem_xfer;
+	mem->transfers++;
+	return start - now;
+}
+
+// account for one trace record: instr and cycle are the record's position in
+// its trace, miss is what memory_access returned for it, and writebacks the
+// blocks it wrote back to memory, as memory_access fills them in
+
+void timing_access (const timing_params *p, timing_core *tc, timing_memory *mem, unsigned long long int instr, unsigned long long int cycle, int op, unsigned int miss, unsigned long long int address, const unsigned long long int *writebacks) {
+	if (instr > tc->last_instr) tc->now += (instr - tc->last_instr) / (double) p->width;
+	tc->last_instr = instr;
+
+	// the rob filled up behind the group's first access
+
+	if (tc->group_open && instr - tc->group_instr >= (unsigned long long int) p->rob) close_group (tc);
+
+	// which level served this access
+
+	int level = 0;
+	double lat = 0.0, wait = 0.0;
+	if (miss & MISS_MEMORY) {
+		level = 3;
+		if (mem->dram_model) {
+			lat = dram_read (mem->dram_model, address, tc->now);
+		} else {
+			wait = memory_transfer (p, mem, tc->now);
+			mem->queue_cycles += wait;
+			lat = p->mem_lat;
+		}
+	} else if (miss & MISS_L2_DEMAND) {
+		level = 2;
+		lat = p->llc_lat;
+	} else if (miss & MISS_L1_DEMAND) {
+		level = 1;
+		lat = p->l2_lat;
+	}
+
+	// dirty blocks leaving the LLC take the channel after the fill
+
+	if (miss & MISS_L3_WRITEBACK) for (int k=0; k<MAX_MEMORY_WRITEBACKS && writebacks[k]; k++) {
+		if (mem->dram_model) {
+			dram_write (mem->dram_model, writebacks[k], tc->now + wait);
+		} else {
+			memory_transfer (p, mem, tc->now + wait);
+		}
+		mem->writebacks++;
+	}
+	if (!level || (op != DAN_DREAD && op != DAN_IREAD)) return;
+	lat = lat > p->l1_lat ? lat - p->l1_lat : 0.0;
+	double end = tc->now + wait + lat;
+
+	// overlap with the current group, or start a new one
+
+	if (tc->group_open && cycle - tc->group_cycle < tc->group_lat) {
+		if (end > tc->group_end) {
+			tc->group_end = end;
+			tc->group_level = level;
+		}
+	} else {
+		close_group (tc);
+		tc->group_open = true;
+		tc->group_instr = instr;
+		tc->group_cycle = cycle;
+		tc->group_lat = (unsigned int) lat;
+		tc->group_end = end;
+		tc->group_level = level;
+		tc->groups++;
+	}
+	tc->grouped++;
+	if (level == 3) tc->group_mem++;
+}
+
+// the cycle a record at instr would issue at on this core: after the
+// instructions before it dispatch and, if the rob is full behind the open
+// group, after the group completes. a miss reaches memory then
+
+double timing_issue_time (const timing_params *p, const timing_core *tc, unsigned long long int instr) {
+	double t = tc->now;
+	if (instr > tc->last_instr) t += (instr - tc->last_instr) / (double) p->width;
+	if (tc->group_open && instr - tc->group_instr >= (unsigned long long int) p->rob && tc->group_end > t) t = tc->group_end;
+	return t;
+}
+
+// cycles so far, counting the time until the current group completes
+
+double timing_cycles (const timing_core *tc) {
+	if (tc->group_open && tc->group_end > tc->now) return tc->group_end;
+	return tc->now;
+}
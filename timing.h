@@ -0,0 +1,64 @@
+// a simple timing model for the exclusive hierarchy
+//
+// model.h turns LLC MPKI into CPI with a linear fit per benchmark, so it
+// only works for the traces it has coefficients for and ignores L2 and LLC
+// hits and writeback traffic. this model instead keeps a cycle count per
+// core as the simulation runs:
+//
+// - instructions between trace records dispatch at width per cycle
+// - a load or ifetch that misses the L1 stalls the core for its latency
+//   (L2 hit, LLC hit or memory) less the L1 latency the pipeline hides.
+//   stores and prefetches don't stall
+// - accesses that start within a window of an earlier one overlap with it
+//   (memory-level parallelism): they must be fewer than rob instructions
+//   and, going by the trace's own cycle field, fewer cycles apart than the
+//   first one's latency. a group of overlapping accesses costs the core
+//   the time until the last of them completes
+// - memory is one shared channel that every transfer (demand fill,
+//   prefetch fill or writeback) occupies for mem_xfer cycles, so
+//   writeback traffic delays later misses. with a DRAM model (dram.h)
+//   memory latency and contention come from that instead
+// - the cores share one time base. the channel and the DRAM compare the
+//   times of requests from different cores, so exclusiu hands the records
+//   to the model in order of the time each would issue at on its core
+//   (timing_issue_time), not in order of the traces' own cycle fields.
+//   every demand miss then arrives no earlier than the ones before it; a
+//   writeback is booked for right after its fill
+
+#include "dram.h"
+
+struct timing_params {
+	int	width;		// instructions dispatched per cycle
+	int	rob;		// instructions in flight; bounds overlap
+	int	l1_lat, l2_lat, llc_lat, mem_lat; // hit latency at each level, memory latency
+	int	mem_xfer;	// cycles one block occupies the memory channel
+};
+
+struct timing_core {
+	double	now;				// cycles so far on this core
+	unsigned long long int last_instr;	// instruction count of the last record
+	bool	group_open;			// later accesses may still overlap with the current group
+	unsigned long long int group_instr, group_cycle; // trace position of the group's first access
+	unsigned int group_lat;			// latency of the group's first access
+	double	group_end;			// when the slowest access in the group completes
+	int	group_level;			// level that served the access completing last: 1 L2, 2 LLC, 3 memory
+	unsigned int group_mem;			// memory accesses in the current group
+	unsigned long long int groups, grouped;	// groups and the stalling accesses in them
+	unsigned long long int mem_groups, mem_grouped; // the same for memory accesses: the MLP estimate
+	double	stall[4];			// stall cycles by the level that ended them
+};
+
+// the shared memory channel
+
+struct timing_memory {
+	double	free_at;			// cycle the channel is next idle
+	unsigned long long int transfers, writebacks;
+	double	queue_cycles;			// cycles demand misses waited for the channel
+	dram	*dram_model;			// the DRAM model, or NULL for the fixed latency and one channel
+};
+
+void init_timing_core (timing_core *tc);
+void init_timing_memory (timing_memory *mem);
+void timing_access (const timing_params *p, timing_core *tc, timing_memory *mem, unsigned long long int instr, unsigned long long int cycle, int op, unsigned int miss, unsigned long long int address, const unsigned long long int *writebacks);
+double timing_cycles (const timing_core *tc);
+double timing_issue_time (const timing_params *p, const timing_core *tc, unsigned long long int instr);
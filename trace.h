@@ -14,11 +14,30 @@ struct trace {
         unsigned long long int cycle;
 };
 
+#include "ctrace.h"
+
 class tracereader {
 	gzFile tracefp;
+	ctrace_reader *ctr; // non-NULL when reading a chunked trace
+	bool pending; // t already holds the next record (left there by seek)
+
+	// in-memory replay: the records of the first pass, delta encoded as in
+	// ctrace.h, so wrapping around doesn't decompress the file again
+
+	std::vector<unsigned char> replay;
+	unsigned long long int replay_budget; // bytes; 0 means don't keep the first pass
+	bool recording, replaying;
+	size_t replay_pos;
+	trace replay_prev;
 	trace t;
 	unsigned long long int icount, current_cycle, current_instr, cyclecount;
 	unsigned long long int insts_upto_restart, cycles_upto_restart;
+
+	// with a skip, each pass starts at skip_instr and counts from the first
+	// record there, whose instr and cycle are base_instr and base_cycle
+
+	unsigned long long int skip_instr, base_instr, base_cycle;
+	bool rebase; // take the base from the next record
 	char filename[1000];
 	long long restart_cycles;
 
@@ -30,6 +49,10 @@ public:
 	// open a trace file
 
 	void open (const char *name) {
+		if (ctrace_probe (name)) {
+			ctr = new ctrace_reader (name);
+			return;
+		}
 		tracefp = gzopen (name, "r");
 		if (!tracefp) {
 			char hostname[1000];
@@ -49,24 +72,132 @@ public:
 		return filename;
 	}
 
+	// keep the decoded first pass in memory, up to budget bytes. must be
+	// called before the first read
+
+	void set_replay_budget (unsigned long long int budget) {
+		replay_budget = budget;
+		recording = budget > 0;
+	}
+
 	void restart (void) {
 		insts_upto_restart += current_instr;
 		cycles_upto_restart += current_cycle;
 		// printf ("restarting \"%s\" at cycle %lld\n", filename, cycles_upto_restart);
 		// fflush (stdout);
-		if (tracefp) gzclose (tracefp);
-		open (filename);
+		if (recording) {
+			// the first pass fit in the budget; from now on play it back from memory
+			recording = false;
+			replaying = true;
+			std::vector<unsigned char> (replay).swap (replay);
+			printf ("keeping \"%s\" in memory: %lld bytes\n", filename, (long long int) replay.size ());
+			fflush (stdout);
+			if (ctr) delete ctr;
+			ctr = NULL;
+			if (tracefp) gzclose (tracefp);
+			tracefp = NULL;
+		}
+		// the recording starts at the skip point, so a replay does too
+
+		if (replaying) {
+			replay_pos = 0;
+			memset (&replay_prev, 0, sizeof (replay_prev));
+			return;
+		}
+		if (ctr) ctr->rewind ();
+		else {
+			if (tracefp) gzclose (tracefp);
+			open (filename);
+		}
+		if (skip_instr) find (skip_instr);
+	}
+
+	// leave the first record with at least instr instructions in t. chunked
+	// traces jump straight there through their index; gzip traces have to
+	// decompress everything before it. past the end, start over with no skip
+
+	void find (unsigned long long int instr) {
+		if (ctr) {
+			ctr->seek (instr);
+			trace *ct = ctr->read ();
+			if (ct) {
+				t = *ct;
+				pending = true;
+				return;
+			}
+			ctr->rewind ();
+		} else {
+			while (gzfread (&t, sizeof (t), 1, tracefp) == 1) {
+				if (t.instr >= instr) {
+					pending = true;
+					return;
+				}
+			}
+			gzrewind (tracefp);
+		}
+		skip_instr = 0;
+	}
+
+	// start reading at instr instead of the beginning. instructions and
+	// cycles then count from there, so warm-up, DAN_MAX_INST and the
+	// statistics don't include the skipped part, and wrapping around comes
+	// back to it
+
+	void seek (unsigned long long int instr) {
+		if (recording) {
+			replay.clear ();
+			memset (&replay_prev, 0, sizeof (replay_prev));
+		}
+		skip_instr = instr;
+		find (instr);
+		rebase = skip_instr != 0;
+	}
+
+	void stop_recording (void) {
+		recording = false;
+		std::vector<unsigned char> ().swap (replay);
 	}
 
 	trace *read (void) {
 	startover:
-		unsigned int a = gzfread (&t, sizeof (t), 1, tracefp);
+		unsigned int a;
+		if (pending) {
+			pending = false;
+			a = 1;
+		} else if (replaying) {
+			a = replay_pos < replay.size ();
+			if (a) {
+				const unsigned char *p = &replay[replay_pos];
+				ctrace_decode (p, &t, &replay_prev);
+				replay_pos = p - &replay[0];
+				replay_prev = t;
+			}
+		} else if (ctr) {
+			trace *ct = ctr->read ();
+			a = ct != NULL;
+			if (ct) t = *ct;
+		} else
+			a = gzfread (&t, sizeof (t), 1, tracefp);
+		if (a && recording) {
+			ctrace_encode (replay, &t, &replay_prev);
+			replay_prev = t;
+			if (replay.size () > replay_budget) {
+				printf ("\"%s\" does not fit in %lld bytes; not keeping it in memory\n", filename, replay_budget);
+				fflush (stdout);
+				stop_recording ();
+			}
+		}
 		if (a == 0) {
 			// printf ("restarting before %lld cycles!\n", restart_cycles);
 			restart_cycles = current_cycle;
 			restart ();
 			goto startover;
 		}
+		if (rebase) {
+			base_instr = t.instr;
+			base_cycle = t.cycle;
+			rebase = false;
+		}
 #if 0
 		// this code was used to generate truncated traces
 		{
@@ -85,7 +216,7 @@ public:
 
 		// heartbeat
 
-		if (t.cycle >= (unsigned long long int) restart_cycles) {
+		if (t.cycle - base_cycle >= (unsigned long long int) restart_cycles) {
 			restart ();
 			goto startover;
 		}
@@ -103,10 +234,10 @@ public:
 		printf ("cmd=%d; pc=%llx; address=%llx; instr=%llx; cycle=%llx\n",
 			t.cmd, t.pc, t.address, t.instr, t.cycle);
 #endif
-		current_cycle = t.cycle;
-		current_instr = t.instr;
-		t.cycle += cycles_upto_restart;
-		t.instr += insts_upto_restart;
+		current_cycle = t.cycle - base_cycle;
+		current_instr = t.instr - base_instr;
+		t.cycle = current_cycle + cycles_upto_restart;
+		t.instr = current_instr + insts_upto_restart;
 		cyclecount = t.cycle;
 		if (t.instr - icount >= 100000000) {
 			icount = t.instr;
@@ -124,8 +255,20 @@ public:
 		current_instr = 0;
 		cycles_upto_restart = 0;
 		insts_upto_restart = 0;
+		skip_instr = 0;
+		base_instr = 0;
+		base_cycle = 0;
+		rebase = false;
 		icount = 0;
 		cyclecount = 0;
+		tracefp = NULL;
+		ctr = NULL;
+		pending = false;
+		replay_budget = 0;
+		recording = false;
+		replaying = false;
+		replay_pos = 0;
+		memset (&replay_prev, 0, sizeof (replay_prev));
 		strcpy (filename, name);
 		open (filename);
 		printf ("opened \"%s\"\n", filename);
@@ -133,7 +276,9 @@ public:
 	}
 
 	void close (void) {
-		gzclose (tracefp);
+		if (ctr) delete ctr;
+		ctr = NULL;
+		if (tracefp) gzclose (tracefp);
 		tracefp = NULL;
 	}
 
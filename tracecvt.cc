@@ -0,0 +1,57 @@
+// convert between gzip traces and chunked traces (see ctrace.h)
+//
+// tracecvt <in> <out>
+//
+// a gzip trace is converted to a chunked trace and vice versa; the input
+// format is detected from the file itself.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include "utils.h"
+#include "replacement_state.h"
+#include "cache.h"
+#include "trace.h"
+
+static long long int file_size (const char *name) {
+	struct stat st;
+	if (stat (name, &st)) return -1;
+	return st.st_size;
+}
+
+int main (int argc, char *argv[]) {
+	if (argc != 3) {
+		fprintf (stderr, "usage: %s <in> <out>\n", argv[0]);
+		return 1;
+	}
+	unsigned long long int n = 0;
+	trace t;
+	if (ctrace_probe (argv[1])) {
+		ctrace_reader in (argv[1]);
+		gzFile out = gzopen (argv[2], "w");
+		if (!out) { perror (argv[2]); return 1; }
+		trace *p;
+		while ((p = in.read ())) {
+			gzwrite (out, p, sizeof (*p));
+			n++;
+		}
+		gzclose (out);
+	} else {
+		gzFile in = gzopen (argv[1], "r");
+		if (!in) { perror (argv[1]); return 1; }
+		ctrace_writer out (argv[2]);
+		while (gzread (in, &t, sizeof (t)) == sizeof (t)) {
+			out.write (&t);
+			n++;
+		}
+		gzclose (in);
+		out.close ();
+	}
+	long long int a = file_size (argv[1]), b = file_size (argv[2]);
+	printf ("%lld records, %lld -> %lld bytes (%0.2fx)\n", n, a, b, b > 0 ? a / (double) b : 0.0);
+	return 0;
+}
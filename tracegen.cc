@@ -0,0 +1,362 @@
+// synthetic trace generator
+//
+// writes traces in the same record layout and CMP$im commands as the SPEC
+// traces, so exclusiu can run without them. the output is a chunked trace
+// if the file name ends in .xtr and a gzip trace otherwise.
+//
+// tracegen [options] <out>
+//	-n N		number of records (default 10M)
+//	-p SPEC		comma separated patterns with optional weights, e.g.
+//			"stream:1,zipf:3". patterns are
+//			  stream	sequential blocks, never reused
+//			  stride	every -s bytes, wrapping around the footprint
+//			  zipf		Zipf-distributed reuse over the footprint (-a)
+//			  chase		pointer chasing: a random cycle through the footprint
+//			  cyclic	sequential loop over the footprint
+//	-f BYTES	footprint of the reusing patterns (default 8MB, twice the LLC)
+//	-s BYTES	stride (default 4096)
+//	-a ALPHA	Zipf exponent (default 0.99)
+//	-w FRAC		fraction of writes (default 0.1)
+//	-r FRAC		fraction of prefetches; they go a few blocks ahead (default 0)
+//	-g N		instructions per access (default 4)
+//	-P N		number of distinct PCs of zipf and chase (default 16); stream,
+//			stride and cyclic each come from one PC, as a loop's accesses would
+//	-S SEED		random seed
+//	-j N		threads (default all CPUs)
+//	-1		fastest compression
+//
+// every record is a pure function of the seed and its index, so the trace is
+// generated and compressed a chunk at a time on all threads and comes out
+// the same whatever the number of threads. each pattern steps through its
+// own sequence, counting only its own records, so mixing patterns doesn't
+// break up a stride, a loop or a chase; a first pass counts each pattern's
+// records before every chunk so the chunks can start where they should.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <vector>
+#include <thread>
+#include <atomic>
+
+using namespace std;
+
+#include "utils.h"
+#include "replacement_state.h"
+#include "cache.h"
+#include "trace.h"
+
+#define PAT_STREAM	0
+#define PAT_STRIDE	1
+#define PAT_ZIPF	2
+#define PAT_CHASE	3
+#define PAT_CYCLIC	4
+#define PAT_MAX		5
+
+static const char *pattern_names[PAT_MAX] = { "stream", "stride", "zipf", "chase", "cyclic" };
+
+long long int nrecords = 10000000;
+unsigned long long int footprint = 8 * 1024 * 1024, stride = 4096, seed = 1;
+double alpha = 0.99, write_frac = 0.1, prefetch_frac = 0.0;
+int gap = 4, npcs = 16, nthreads = 0, level = Z_DEFAULT_COMPRESSION;
+double weights[PAT_MAX];
+double cum_weights[PAT_MAX];
+
+unsigned long long int nblocks; // footprint in 64-byte blocks
+double *zipf_cdf; // cumulative Zipf probabilities by rank
+unsigned long long int chase_bits, chase_a, chase_c; // full-period LCG over 2^chase_bits nodes
+
+// stateless hash of (seed, index, salt) to 64 random bits
+
+static inline unsigned long long int mix (unsigned long long int i, unsigned long long int salt) {
+	unsigned long long int x = i * 0x9e3779b97f4a7c15ull + salt * 0xbf58476d1ce4e5b9ull + seed;
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ull;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebull;
+	x ^= x >> 31;
+	return x;
+}
+
+static inline double uniform (unsigned long long int i, unsigned long long int salt) {
+	return (mix (i, salt) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// spread block numbers over the footprint so the irregular patterns (zipf
+// ranks, chase nodes) don't line up with sets. the regular ones keep their
+// addresses, so their strides are real
+
+static inline unsigned long long int scatter (unsigned long long int block, unsigned long long int base) {
+	return base + ((block * 0x5bd1e995ull) % nblocks) * 64;
+}
+
+// node i steps into a pointer chase: x_i = a^i x_0 + c (a^i - 1)/(a - 1), by repeated squaring
+
+static unsigned long long int chase_node (unsigned long long int i) {
+	unsigned long long int mask = (1ull << chase_bits) - 1;
+	unsigned long long int acc_a = 1, acc_c = 0, a = chase_a, c = chase_c;
+	while (i) {
+		if (i & 1) {
+			acc_a = (acc_a * a) & mask;
+			acc_c = (acc_c * a + c) & mask;
+		}
+		c = ((a + 1) * c) & mask;
+		a = (a * a) & mask;
+		i >>= 1;
+	}
+	return (acc_a * 1 + acc_c) & mask;
+}
+
+// the pattern record i uses
+
+static inline int pattern (long long int i) {
+	double u = uniform (i, 1) * cum_weights[PAT_MAX-1];
+	int p = 0;
+	while (cum_weights[p] <= u) p++;
+	return p;
+}
+
+// pos[p] is the number of records before this one that used pattern p, its
+// position in that pattern's sequence; chase_state is the chase's node at
+// pos[PAT_CHASE]
+
+static void make_record (long long int i, trace *t, unsigned long long int *pos, unsigned long long int *chase_state) {
+	int p = pattern (i);
+	unsigned long long int n = pos[p]++;
+	unsigned long long int base = (unsigned long long int) (p + 1) << 40, block;
+	switch (p) {
+	case PAT_STREAM: block = n; break;
+	case PAT_STRIDE: block = (n * (stride / 64)) % nblocks; break;
+	case PAT_ZIPF: {
+		double z = uniform (i, 2);
+		unsigned long long int lo = 0, hi = nblocks - 1;
+		while (lo < hi) {
+			unsigned long long int mid = (lo + hi) / 2;
+			if (zipf_cdf[mid] < z) lo = mid + 1; else hi = mid;
+		}
+		block = lo;
+		break;
+	}
+	case PAT_CHASE:
+		// the chain advances by one node per chase access
+		block = *chase_state;
+		*chase_state = (chase_a * *chase_state + chase_c) & ((1ull << chase_bits) - 1);
+		break;
+	default: block = n % nblocks; break;
+	}
+	bool regular = p == PAT_STREAM || p == PAT_STRIDE || p == PAT_CYCLIC;
+	if (p == PAT_STREAM) t->address = base + block * 64;
+	else if (regular) t->address = base + (block % nblocks) * 64;
+	else t->address = scatter (block % nblocks, base);
+	t->address += (mix (i, 3) & 15) * 4;
+	t->pc = 0x400000 + p * 0x10000 + (regular ? 0 : (mix (i, 4) % npcs) * 4);
+	t->size = 4;
+	double c = uniform (i, 5);
+	if (c < prefetch_frac) {
+		t->cmd = ACCESS_PREFETCH;
+		t->address += 4 * 64;
+	} else if (c < prefetch_frac + write_frac) {
+		t->cmd = ACCESS_STORE;
+	} else {
+		t->cmd = ACCESS_LOAD;
+	}
+
+	// instructions only ever go up: i*gap plus a jitter below gap
+
+	t->instr = (unsigned long long int) i * gap + mix (i, 6) % gap;
+	t->cycle = t->instr;
+}
+
+static void parse_patterns (char *spec) {
+	memset (weights, 0, sizeof (weights));
+	for (char *tok = strtok (spec, ","); tok; tok = strtok (NULL, ",")) {
+		char *colon = strchr (tok, ':');
+		double w = 1.0;
+		if (colon) {
+			*colon = 0;
+			w = atof (colon + 1);
+		}
+		int p;
+		for (p=0; p<PAT_MAX; p++) if (!strcmp (tok, pattern_names[p])) break;
+		if (p == PAT_MAX) {
+			fprintf (stderr, "unknown pattern \"%s\"\n", tok);
+			exit (1);
+		}
+		weights[p] += w;
+	}
+}
+
+static void setup (void) {
+	double sum = 0;
+	for (int p=0; p<PAT_MAX; p++) {
+		sum += weights[p];
+		cum_weights[p] = sum;
+	}
+	assert (sum > 0);
+	nblocks = footprint / 64;
+	assert (nblocks > 0);
+	if (weights[PAT_ZIPF] > 0) {
+		zipf_cdf = new double[nblocks];
+		double z = 0;
+		for (unsigned long long int k=0; k<nblocks; k++) z += 1.0 / pow (k + 1, alpha);
+		double c = 0;
+		for (unsigned long long int k=0; k<nblocks; k++) {
+			c += 1.0 / pow (k + 1, alpha) / z;
+			zipf_cdf[k] = c;
+		}
+		zipf_cdf[nblocks-1] = 1.0;
+	}
+
+	// a full-period LCG mod 2^k (a = 1 mod 4, c odd) visits every node once per lap
+
+	for (chase_bits=1; (1ull << chase_bits) < nblocks; chase_bits++);
+	chase_a = ((mix (0, 7) & ((1ull << chase_bits) - 1)) & ~3ull) | 1 | 4;
+	chase_c = mix (0, 8) | 1;
+}
+
+struct segment {
+	vector<trace> records;
+	vector<unsigned char> raw, packed;
+};
+
+// the records of segment s
+
+static long long int segment_records (long long int s) {
+	long long int n = nrecords - s * CTRACE_CHUNK_RECORDS;
+	return n > CTRACE_CHUNK_RECORDS ? CTRACE_CHUNK_RECORDS : n;
+}
+
+// how many records of each pattern come before each segment: count each
+// segment's on all threads, then add them up in order
+
+static vector<unsigned long long int> pattern_starts (long long int nsegs) {
+	vector<unsigned long long int> starts ((nsegs + 1) * PAT_MAX, 0);
+	atomic<long long int> next (0);
+	vector<thread> workers;
+	for (int k=0; k<nthreads; k++) {
+		workers.push_back (thread ([&] () {
+			for (long long int s; (s = next++) < nsegs; ) {
+				long long int first = s * CTRACE_CHUNK_RECORDS, n = segment_records (s);
+				for (long long int i=0; i<n; i++) starts[(s + 1) * PAT_MAX + pattern (first + i)]++;
+			}
+		}));
+	}
+	for (size_t k=0; k<workers.size (); k++) workers[k].join ();
+	for (long long int s=1; s<=nsegs; s++)
+		for (int p=0; p<PAT_MAX; p++) starts[s * PAT_MAX + p] += starts[(s - 1) * PAT_MAX + p];
+	return starts;
+}
+
+// generate and compress segment s of the trace; start is where each pattern's
+// sequence stands at its start
+
+static void build (long long int s, const unsigned long long int *start, segment *seg, bool chunked) {
+	long long int first = s * CTRACE_CHUNK_RECORDS, n = segment_records (s);
+	seg->records.resize (n);
+	unsigned long long int pos[PAT_MAX];
+	memcpy (pos, start, sizeof (pos));
+	unsigned long long int chase_state = chase_node (pos[PAT_CHASE]);
+	for (long long int i=0; i<n; i++) make_record (first + i, &seg->records[i], pos, &chase_state);
+	if (chunked) {
+		ctrace_pack (&seg->records[0], n, seg->raw, seg->packed, level);
+		return;
+	}
+
+	// a gzip member of its own; gzip readers take concatenated members as one stream
+
+	z_stream z;
+	memset (&z, 0, sizeof (z));
+	int r = deflateInit2 (&z, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+	assert (r == Z_OK);
+	uLong in = n * sizeof (trace);
+	seg->packed.resize (deflateBound (&z, in));
+	z.next_in = (Bytef *) &seg->records[0];
+	z.avail_in = in;
+	z.next_out = &seg->packed[0];
+	z.avail_out = seg->packed.size ();
+	r = deflate (&z, Z_FINISH);
+	assert (r == Z_STREAM_END);
+	seg->packed.resize (z.total_out);
+	deflateEnd (&z);
+}
+
+int main (int argc, char *argv[]) {
+	char patterns[1000] = "zipf";
+	int c;
+	while ((c = getopt (argc, argv, "n:p:f:s:a:w:r:g:P:S:j:1")) != -1) {
+		switch (c) {
+		case 'n': nrecords = atoll (optarg); break;
+		case 'p': strncpy (patterns, optarg, sizeof (patterns) - 1); break;
+		case 'f': footprint = strtoull (optarg, NULL, 0); break;
+		case 's': stride = strtoull (optarg, NULL, 0); break;
+		case 'a': alpha = atof (optarg); break;
+		case 'w': write_frac = atof (optarg); break;
+		case 'r': prefetch_frac = atof (optarg); break;
+		case 'g': gap = atoi (optarg); break;
+		case 'P': npcs = atoi (optarg); break;
+		case 'S': seed = strtoull (optarg, NULL, 0); break;
+		case 'j': nthreads = atoi (optarg); break;
+		case '1': level = Z_BEST_SPEED; break;
+		default:
+			fprintf (stderr, "usage: %s [-n records] [-p pattern[:weight],...] [-f footprint] [-s stride] [-a alpha] [-w writes] [-r prefetches] [-g insts/access] [-P pcs] [-S seed] [-j threads] [-1] <out>\n", argv[0]);
+			return 1;
+		}
+	}
+	if (optind != argc - 1) {
+		fprintf (stderr, "%s: need an output file\n", argv[0]);
+		return 1;
+	}
+	const char *name = argv[optind];
+	size_t len = strlen (name);
+	bool chunked = len > 4 && !strcmp (name + len - 4, ".xtr");
+	if (gap < 1) gap = 1;
+	if (stride < 64) stride = 64;
+	if (nthreads <= 0) nthreads = thread::hardware_concurrency ();
+	if (nthreads <= 0) nthreads = 1;
+	parse_patterns (patterns);
+	setup ();
+
+	FILE *gz = NULL;
+	ctrace_writer *ct = NULL;
+	if (chunked)
+		ct = new ctrace_writer (name);
+	else {
+		gz = fopen (name, "w");
+		if (!gz) { perror (name); return 1; }
+	}
+
+	// build a batch of segments on all threads, then write them in order
+
+	long long int nsegs = (nrecords + CTRACE_CHUNK_RECORDS - 1) / CTRACE_CHUNK_RECORDS;
+	vector<unsigned long long int> starts = pattern_starts (nsegs);
+	int batch = nthreads * 4;
+	vector<segment> segs (batch);
+	for (long long int s0=0; s0<nsegs; s0+=batch) {
+		int m = nsegs - s0 < batch ? nsegs - s0 : batch;
+		atomic<int> next (0);
+		vector<thread> workers;
+		for (int k=0; k<nthreads; k++) {
+			workers.push_back (thread ([&] () {
+				for (int j; (j = next++) < m; ) build (s0 + j, &starts[(s0 + j) * PAT_MAX], &segs[j], chunked);
+			}));
+		}
+		for (size_t k=0; k<workers.size (); k++) workers[k].join ();
+		for (int j=0; j<m; j++) {
+			if (chunked)
+				ct->write_packed (segs[j].records[0].instr, segs[j].records.size (), segs[j].raw.size (), segs[j].packed);
+			else
+				fwrite (&segs[j].packed[0], 1, segs[j].packed.size (), gz);
+		}
+	}
+	if (ct) {
+		ct->close ();
+		delete ct;
+	}
+	if (gz) fclose (gz);
+	printf ("%lld records written to %s\n", nrecords, name);
+	return 0;
+}
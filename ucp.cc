@@ -0,0 +1,173 @@
+// utility-based cache partitioning (see ucp.h)
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "utils.h"
+#include "replacement_state.h"
+#include "cache.h"
+#include "ucp.h"
+
+// the core a block belongs to, from the core id exclusiu puts in address bits 56 and up
+
+static inline int owner_of_block (ucp_state *u, cache *c, unsigned long long int block_addr) {
+	return (int) ((block_addr >> (56 - c->offset_bits)) % u->ncores);
+}
+
+static inline int owner_of_tag (ucp_state *u, cache *c, unsigned long long int tag, unsigned int set) {
+	return owner_of_block (u, c, index_block (c, tag, set));
+}
+
+ucp_state *new_ucp (cache *c, int ncores, int interval) {
+	ucp_state *u = new ucp_state;
+	u->ncores = ncores;
+	u->assoc = c->assoc;
+	u->nsets = c->nsets;
+	u->sample_every = c->nsets > UCP_SAMPLED_SETS ? c->nsets / UCP_SAMPLED_SETS : 1;
+	u->interval = interval;
+	u->umon = new unsigned long long int *[ncores];
+	u->hits = new unsigned long long int *[ncores];
+	u->alloc = new int[ncores];
+	u->alloc_sum = new unsigned long long int[ncores];
+	int sampled = (c->nsets + u->sample_every - 1) / u->sample_every;
+	for (int i=0; i<ncores; i++) {
+		u->umon[i] = new unsigned long long int[sampled * c->assoc];
+		memset (u->umon[i], 0, sizeof (unsigned long long int) * sampled * c->assoc);
+		u->hits[i] = new unsigned long long int[c->assoc];
+		memset (u->hits[i], 0, sizeof (unsigned long long int) * c->assoc);
+
+		// an even split until the monitors have something to say
+
+		u->alloc[i] = c->assoc / ncores + (i < c->assoc % ncores);
+		u->alloc_sum[i] = 0;
+	}
+	u->accesses = 0;
+	u->repartitions = 0;
+	u->overrides = 0;
+	return u;
+}
+
+// lookahead: hand out the ways one grant at a time to the core with the
+// most hits per extra way, looking as many ways ahead as are left
+
+static void repartition (ucp_state *u) {
+	int balance = u->assoc - u->ncores;
+	if (balance < 0) return;
+	for (int i=0; i<u->ncores; i++) u->alloc[i] = 1;
+	while (balance > 0) {
+		double best = -1.0;
+		int best_core = 0, best_ways = 1;
+		for (int i=0; i<u->ncores; i++) {
+			unsigned long long int gain = 0;
+			for (int k=1; k<=balance; k++) {
+				gain += u->hits[i][u->alloc[i] + k - 1];
+				double mu = gain / (double) k;
+				if (mu > best) {
+					best = mu;
+					best_core = i;
+					best_ways = k;
+				}
+			}
+		}
+		u->alloc[best_core] += best_ways;
+		balance -= best_ways;
+	}
+	for (int i=0; i<u->ncores; i++) {
+		for (int k=0; k<u->assoc; k++) u->hits[i][k] /= 2;
+		u->alloc_sum[i] += u->alloc[i];
+	}
+	u->repartitions++;
+}
+
+// the shadow stack for this block's sampled set, or NULL if the set isn't sampled
+
+static unsigned long long int *umon_stack (ucp_state *u, cache *c, unsigned long long int block_addr, int *core) {
+	unsigned int set = index_set (c, block_addr);
+	if (set % u->sample_every) return NULL;
+	*core = owner_of_block (u, c, block_addr);
+	return &u->umon[*core][(set / u->sample_every) * u->assoc];
+}
+
+static int umon_find (ucp_state *u, unsigned long long int *stack, unsigned long long int block_addr) {
+	for (int k=0; k<u->assoc; k++) if (stack[k] == block_addr + 1) return k;
+	return -1;
+}
+
+// move position k (or the bottom, if k is -1) to the top with this block
+
+static void umon_to_mru (ucp_state *u, unsigned long long int *stack, int k, unsigned long long int block_addr) {
+	if (k < 0) k = u->assoc - 1;
+	memmove (&stack[1], &stack[0], k * sizeof (*stack));
+	stack[0] = block_addr + 1;
+}
+
+// train the monitors on an LLC access: demand accesses count a hit at the
+// depth they find the block and move it to the top; placed blocks go on top
+
+void ucp_observe (ucp_state *u, cache *c, unsigned long long int address, int op, bool do_place) {
+	unsigned long long int block_addr = address >> c->offset_bits;
+	int core;
+	if (op != DAN_WRITEBACK && ++u->accesses % u->interval == 0) repartition (u);
+	unsigned long long int *stack = umon_stack (u, c, block_addr, &core);
+	if (!stack) return;
+	int k = umon_find (u, stack, block_addr);
+	if (op != DAN_WRITEBACK && k >= 0) u->hits[core][k]++;
+	if (k >= 0 || do_place) umon_to_mru (u, stack, k, block_addr);
+}
+
+// a block invalidated out of the LLC leaves the monitor too; this is how an
+// exclusive LLC's monitor loses the blocks that move up to the L1
+
+void ucp_invalidate (ucp_state *u, cache *c, unsigned long long int address) {
+	unsigned long long int block_addr = address >> c->offset_bits;
+	int core;
+	unsigned long long int *stack = umon_stack (u, c, block_addr, &core);
+	if (!stack) return;
+	int k = umon_find (u, stack, block_addr);
+	if (k < 0) return;
+	memmove (&stack[k], &stack[k+1], (u->assoc - k - 1) * sizeof (*stack));
+	stack[u->assoc-1] = 0;
+}
+
+// the way to replace in a full set for an incoming block, given the way the
+// replacement policy proposed. recency is the position in the set under LRU
+// (blocks are kept in stack order) and the CRC LRU stack otherwise
+
+int ucp_victim (ucp_state *u, cache *c, unsigned int set, unsigned long long int block_addr, int proposed) {
+	block *v = &c->sets[set].blocks[0];
+	int occ[MAX_ASSOC], owner[MAX_ASSOC];
+	int me = owner_of_block (u, c, block_addr);
+	assert (u->ncores <= MAX_ASSOC);
+	memset (occ, 0, sizeof (occ));
+	for (int i=0; i<c->assoc; i++) {
+		owner[i] = owner_of_tag (u, c, v[i].tag, set);
+		occ[owner[i]]++;
+	}
+	bool under = occ[me] < u->alloc[me];
+	if (proposed >= 0) {
+		int o = owner[proposed];
+		if (under ? occ[o] > u->alloc[o] : o == me) return proposed;
+	}
+	int best = -1;
+	unsigned int best_age = 0;
+	for (int i=0; i<c->assoc; i++) {
+		int o = owner[i];
+		if (under ? occ[o] <= u->alloc[o] : o != me) continue;
+		unsigned int age = c->replacement_policy == REPLACEMENT_POLICY_LRU ? i : c->repl->repl[set][i].LRUstackposition;
+		if (best < 0 || age > best_age) {
+			best = i;
+			best_age = age;
+		}
+	}
+	if (best < 0) return proposed;
+	u->overrides++;
+	return best;
+}
+
+void ucp_print_stats (ucp_state *u) {
+	printf ("UCP ways now:");
+	for (int i=0; i<u->ncores; i++) printf (" core %d: %d", i, u->alloc[i]);
+	printf ("\nUCP mean ways:");
+	for (int i=0; i<u->ncores; i++) printf (" core %d: %0.2f", i, u->repartitions ? u->alloc_sum[i] / (double) u->repartitions : (double) u->alloc[i]);
+	printf ("\nUCP repartitions: %lld victims moved: %lld\n", u->repartitions, u->overrides);
+}
@@ -0,0 +1,33 @@
+// utility-based cache partitioning (Qureshi and Patt, MICRO 2006) for the LLC
+//
+// each core has a utility monitor (UMON): an LRU stack of shadow tags for a
+// few sampled sets, as if the core had the whole LLC to itself, counting
+// hits by stack position. hits[c][k] is then what core c would gain from
+// a (k+1)th way. every interval LLC accesses the lookahead algorithm splits
+// the ways among the cores by marginal utility, at least one each, and the
+// counters are halved so the curves follow phase changes.
+//
+// the split is enforced when the LLC replaces a block: a core below its
+// share takes the least recently used block of a core above its share;
+// a core at or above its share replaces one of its own. the block's owner
+// is the core id exclusiu keeps in address bits 56 and up.
+
+#define UCP_SAMPLED_SETS	32
+
+struct cache;
+
+struct ucp_state {
+	int	ncores, assoc, nsets, sample_every, interval;
+	unsigned long long int **umon;	// [core][sampled set * assoc + position] block address + 1, 0 if empty
+	unsigned long long int **hits;	// [core][position]
+	int	*alloc;			// ways each core may hold in a set
+	unsigned long long int accesses, repartitions;
+	unsigned long long int overrides; // victims the policy chose that the partition moved elsewhere
+	unsigned long long int *alloc_sum; // alloc summed over repartitions, for the mean
+};
+
+ucp_state *new_ucp (cache *c, int ncores, int interval);
+void ucp_observe (ucp_state *u, cache *c, unsigned long long int address, int op, bool do_place);
+void ucp_invalidate (ucp_state *u, cache *c, unsigned long long int address);
+int ucp_victim (ucp_state *u, cache *c, unsigned int set, unsigned long long int block_addr, int proposed);
+void ucp_print_stats (ucp_state *u);
@@ -13,6 +13,12 @@ typedef unsigned long long int Addr_t;
 
 struct LINE_STATE {
 	Addr_t tag;
+	bool prefetched; // block was brought in by a prefetch and has not seen a demand hit yet
+	Addr_t filling_pc; // pc that filled the block; kept when the block moves between levels with its metadata
+	int offset; // offset of *byte* that caused this block to be filled
+	UINT32 signature; // hashed filling pc, carried from level to level
+	UINT32 hits; // hits at this level since the block was placed here
+	UINT32 reuse; // reuse history from the levels the block was in: bit 0 = hit in the last one, bit 1 = the one before that
 };
 
 #endif